@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <cstdint>
 #include <cstring>
 #include <string>
@@ -7,7 +8,7 @@
 #include <memory>
 #include <vector>
 #include <map>
-#include "crc32.h"
+#include "fpqpack.h"
 #include "version.h"
 
 #ifdef _WIN32
@@ -22,7 +23,8 @@
 #endif
 
 #define VER                 " v" VERSION
-#define DEFAULT_SERIAL        "B00B0069"
+#define MAX_BUFFER_MB         16
+#define MAX_JOBS              256
 #define PRINT_CAPTION       do { \
                                 uint8_t fpq_x[15] = {0x19,0x0f,0x22,0x54,0x25, \
                                                     0x0d,0x00,0x03,0x0c,0x19, \
@@ -52,226 +54,80 @@
 void printHelp() {
     std::cout << "Usage: fpq_pack [-k] [encryption key] [-h] [serial number] [-d] [debug]" << std::endl;
     std::cout << "                [-o] [output file]    [-l] [log file]" << std::endl;
+    std::cout << "                [-m] [buffer size, MB] [-j] [jobs]" << std::endl;
+    std::cout << "                [-i] [io backend]     [-u] [image]" << std::endl;
+    std::cout << "                [-v] [image] [more images...]" << std::endl;
+    std::cout << "                [-n] [serial range | @serial list]" << std::endl;
+    std::cout << "                [-r] [image]          [-t] [stats format]" << std::endl;
+    std::cout << "                [-e] [cache dir]      [-z] [cache size, MB]" << std::endl;
+    std::cout << "                [-a] [section crcs]   [-p] [compressed sections]" << std::endl;
+    std::cout << "                [-y] [base image]     [-g] [new image] | [-w] [patch]" << std::endl;
+    std::cout << "                [-D] [socket] | [-S] [socket] [command]" << std::endl;
+    std::cout << "                [-W] [output mode]    [-M] [sha256 manifest]" << std::endl;
+    std::cout << "                [-V] [variants manifest]" << std::endl;
     std::cout << "                [-c] [file]" << std::endl;
     std::cout << "                [-b] [file]" << std::endl;
     std::cout << "                [-s] [file]" << std::endl;
     std::cout << "                [-x] [file]" << std::endl;
     std::cout << "                [-f] [file]" << std::endl << std::endl;
     std::cout << "Used to encrypt and package FPQ firmware into a single file." << std::endl;
-    std::cout << "\t -o, \toutput file path" << std::endl;
+    std::cout << "\t -o, \toutput file path, '-' streams the image to stdout" << std::endl;
     std::cout << "\t -k, \tencryption key string" << std::endl;
     std::cout << "\t -d, \tdebug mode on (any value)" << std::endl;
     std::cout << "\t -l, \tlog to file (in debug mode)" << std::endl;
+    std::cout << "\t -m, \tI/O buffer size in MB, 1.." << MAX_BUFFER_MB << " (default: " << DEFAULT_BUFFER_MB << ")" << std::endl;
+    std::cout << "\t -j, \tparallel jobs, 0 - one per CPU (default: 1)" << std::endl;
+    std::cout << "\t -i, \tI/O backend: stdio, mmap, uring (default: stdio); uring keeps max(4, jobs) chunks in flight" << std::endl;
+    std::cout << "\t -u, \tunpack image into sections ('-o' is the output directory)" << std::endl;
+    std::cout << "\t -v, \tverify images, prints one JSON line per image" << std::endl;
+    std::cout << "\t -n, \tbatch: one image per serial, 'FIRST-LAST' hex range or '@file' with a serial per line;" << std::endl;
+    std::cout << "\t    \t'-o' is the output directory, images are named firmware_<serial>.bin" << std::endl;
+    std::cout << "\t -r, \trepack in place: replace only the given sections (and serial with '-h')" << std::endl;
+    std::cout << "\t -t, \tprint per-section, per-phase timing: table, json (alone on stdout, messages go to stderr)" << std::endl;
+    std::cout << "\t -e, \treuse encrypted sections from a cache directory, keyed by content and key" << std::endl;
+    std::cout << "\t -z, \tcache size cap, least recently used sections go first (default: " << DEFAULT_CACHE_MB << ")" << std::endl;
+    std::cout << "\t -a, \tstore plain and encrypted CRC32 of every section in the header (any value)" << std::endl;
+    std::cout << "\t -p, \tcompress sections before encryption: comma separated config, uboot, linux, liteos, rootfs" << std::endl;
+    std::cout << "\t    \tor 'all'; unpack restores them to their exact size" << std::endl;
+    std::cout << "\t -g, \tdelta: write a patch from the '-y' image to this one into '-o' (default: firmware.delta)" << std::endl;
+    std::cout << "\t -w, \tapply a patch to the '-y' image, the result goes to '-o'" << std::endl;
+    std::cout << "\t -y, \tbase image for '-g' and '-w'" << std::endl;
+    std::cout << "\t -D, \tdaemon: serve pack, batch and verify requests on a Unix socket with '-j' workers," << std::endl;
+    std::cout << "\t    \tkeeping encrypted sections in memory up to the '-z' size" << std::endl;
+    std::cout << "\t -S, \tsend this pack, batch ('-n') or verify ('-v') request to a daemon instead;" << std::endl;
+    std::cout << "\t    \ta trailing 'stats' or 'quit' argument is sent as is" << std::endl;
+    std::cout << "\t -W, \toutput mode: buffered, direct (O_DIRECT, 4 KiB aligned, max(4, jobs) writes in flight)," << std::endl;
+    std::cout << "\t    \tverify (direct and every write read back and compared); '-o' may be a block device" << std::endl;
+    std::cout << "\t -M, \tSHA-256 of every input and of the image into '<output>.sha256' while packing, in" << std::endl;
+    std::cout << "\t    \tsha256sum format (any value); the image is then written in order, header first" << std::endl;
+    std::cout << "\t -V, \tbuild matrix: pack every variant listed in this file, one per line as" << std::endl;
+    std::cout << "\t    \t'o=OUTPUT [c=|b=|x=|s=|f=PATH] [k=KEY] [h=SERIAL]'; left out fields come from the command line," << std::endl;
+    std::cout << "\t    \tevery distinct input is read once for all variants" << std::endl;
     std::cout << "\t -c, \tfirmware: 'config' path" << std::endl;
     std::cout << "\t -b, \tfirmware: 'u-boot.bin' path" << std::endl;
     std::cout << "\t -x, \tfirmware: 'uImage' path" << std::endl;
     std::cout << "\t -s, \tfirmware: 'media_app_zip.bin' path" << std::endl;
     std::cout << "\t -f, \tfirmware: 'rootfs.cramfs.img' path" << std::endl;
     std::cout << "\t -h, \tfirmware: serial hex string (default: B00B0069)" << std::endl << std::endl;
+    std::cout << "Firmware paths may be '-' (stdin), pipes or FIFOs: give their size as 'path:SIZE' (bytes)." << std::endl;
+    std::cout << "Such inputs, or an output that is not a regular file, are packed in one pass without seeking." << std::endl << std::endl;
 }
 
-class FPQLog {
-    public:
-        FPQLog(std::ostream *os = &std::cout) : os(os) { }
-
-        FPQLog &operator=(const FPQLog &log) { this->os = log.os; return *this; }
-
-        template<typename T>
-        void operator()(T t) { *os << t; }
-
-        template<typename F, typename T>
-        void operator()(F f, T t) { *os << f << t; }
-
-        template<typename F, typename T, typename... Args> 
-        void operator()(F f, T t, Args... args) { *os << f << t; this->operator()(args...); }
-    private:
-        std::ostream *os;
-};
-
-struct FPQHeader {
-    typedef uint8_t* iterator;
-    struct _field { uint32_t size; uint32_t offset; };
-
-    FPQHeader() {
-        const std::string magic("~magic~firmware~");
-        std::copy(magic.begin(), magic.end(), firmware_magic);   
-        std::fill_n(begin() + magic.length(), sizeof(_field) * FileNum_, 0);
-    }
-
-    char firmware_magic[16];   
-    _field _config;
-    _field _serial;
-    _field _uboot;
-    _field _linux;
-    _field _liteos;
-    _field _rootfs;
-
-    enum Type { Config = 0, Serial, UBoot, Linux, LiteOS, RootFS, FileNum_ };
-
-    iterator begin(void) { return (uint8_t*)firmware_magic; }
-
-    iterator end(void) { return (uint8_t*)(firmware_magic + blkSize()); }
-
-    void setSize(FPQHeader::Type type, uint32_t size) {
-        switch(type) {
-            case Config: _config.size = align(size); break;
-            case Serial: _serial.size = align(size); break;
-            case UBoot: _uboot.size = align(size); break;
-            case Linux: _linux.size = align(size); break;
-            case LiteOS: _liteos.size = align(size); break;
-            case RootFS: _rootfs.size = align(size); break;
-            default: break;
-        }
-    }
-
-    void updateOffsets(void) {
-        _config.offset = blkSize();
-        _serial.offset = _config.offset + _config.size;
-        _uboot.offset = _serial.offset + _serial.size;
-        _linux.offset = _uboot.offset + _uboot.size;
-        _liteos.offset = _linux.offset + _linux.size;
-        _rootfs.offset = _liteos.offset + _liteos.size;
-    }
-
-    void dumpLog(FPQLog &log){
-        log("****************************************\n");
-        log(std::hex, "config size: 0x", _config.size, ", offset: 0x", _config.offset, "\n");
-        log("serial size: 0x", _serial.size, ", offset: 0x", _serial.offset, "\n");
-        log("uboot size: 0x", _uboot.size, ", offset: 0x", _uboot.offset, "\n");
-        log("linux size: 0x", _linux.size, ", offset: 0x", _linux.offset, "\n");
-        log("liteos size: 0x", _liteos.size, ", offset: 0x", _liteos.offset, "\n");
-        log("rootfs size: 0x", _rootfs.size, ", offset: 0x", _rootfs.offset, "\n");
-        log("****************************************\n");
-    }
-    
-    static std::vector<uint8_t> makeSerial(uint32_t serial) {
-        std::vector<uint8_t> serialBlk(blkSize());
-        union { 
-            uint32_t value, crc; 
-            uint8_t bytes[sizeof(uint32_t)];
-        } _serial { serial };
-
-        auto it = serialBlk.begin();
-        while(it != serialBlk.end()) {
-            std::copy(_serial.bytes, _serial.bytes + sizeof(uint32_t), it);
-            it += sizeof(uint32_t);
-        }
-
-        _serial.crc = CRC32_Calculate(serialBlk.data(), blkSize() - sizeof(uint32_t));
-        std::copy(_serial.bytes, _serial.bytes + sizeof(uint32_t), it - sizeof(uint32_t));
-
-        return serialBlk;
-    }
-
-    static uint32_t align(uint32_t value) {
-        return (value % blkSize()) ? value + (blkSize() - (value % blkSize())) : value;
-    }
-
-    static uint32_t blkSize(void) {
-        return sizeof(FPQHeader);
-    }
-
-    static std::string getName(int type) { 
-        return fileNames[type]; 
+// Section list for '-p', returns one bit per FPQHeader::Type
+uint32_t parseSections(const std::string &spec) {
+    const std::vector<std::string> names = { "config", "", "uboot", "linux", "liteos", "rootfs" };
+    uint32_t sections = 0;
+    std::string name;
+    std::istringstream list(spec);
+
+    while (std::getline(list, name, ',')) {
+        auto it = std::find(names.begin(), names.end(), name);
+        if (name == "all") sections |= ~(1U << FPQHeader::Type::Serial) & ((1U << FPQHeader::Type::FileNum_) - 1);
+        else if (!name.empty() && it != names.end()) sections |= 1U << (it - names.begin());
+        else throw std::runtime_error(std::string("Unknown section '" + name + "'!").c_str());
     }
-
-    static const std::vector<std::string> fileNames;
-
-} __attribute__((aligned(512)));
-const std::vector<std::string> FPQHeader::fileNames = { "Config","Serial","UBoot","Linux","Liteos","Rootfs" };
-
-class FPQSerial {
-    public:
-        FPQSerial(const std::string &serialStr) {
-            if (!isValid(serialStr)) throw std::runtime_error("Invalid serial number!");
-            serial = std::stoul(serialStr, 0, 16);
-            this->serialStr = serialStr;
-        }
-        FPQSerial() : FPQSerial(DEFAULT_SERIAL) { }
-
-        uint32_t get(void) const { return serial; }
-        std::string getStr(void) const { return serialStr; }
-
-        FPQSerial &operator=(const FPQSerial &serial) { this->serial = serial.serial; return *this; }
-
-    private:
-        bool isValid(const std::string &serial) {
-            if (serial.length() != correctLen) return false;
-
-            auto validator = [](char ch) {
-                char c = std::tolower(ch);
-                if (c < '0' || c > '9')
-                    if (c < 'a' || c > 'f') return false;
-                return true;
-            };
-
-            return std::find_if_not(serial.begin(), serial.end(), validator) == serial.end();
-        }
-
-        const size_t correctLen = 8;    // strlen(DEFAULT_SERIAL)
-        uint32_t serial;
-        std::string serialStr;
-};
-
-class FPQFile {
-    public:
-        enum class OpenMode {RWOpen, RWCreate};
-
-        explicit FPQFile(std::string path, FPQFile::OpenMode mode) : file(NULL), fileSize(0) {
-            file = fopen(path.c_str(), (mode == FPQFile::OpenMode::RWCreate) ? "w+b" : "r+b");
-            if (!file) throw std::runtime_error(std::string("Unable open '" + path + "'!").c_str());       
-            fseek(file, 0L, SEEK_END);
-            fileSize = ftell(file);
-            fseek(file, 0L, SEEK_SET);
-            this->path = path;
-        }
-        explicit FPQFile(std::string path) : FPQFile(path, FPQFile::OpenMode::RWOpen) {}
-        ~FPQFile() { if (file) fclose(file); }
-
-        void setPos(long offset) { fseek(file, offset, SEEK_SET); }
-
-        unsigned size() const { return fileSize; }
-
-        void read(uint8_t *data, unsigned size) {
-            if (fread(data, sizeof(uint8_t), size, file) != size)
-                throw std::runtime_error(std::string("Unable to read from '" + path + "'!").c_str());
-        }
-
-        void write(std::vector<uint8_t> &data) {
-            if (fwrite(data.data(), sizeof(uint8_t), data.size(), file) != data.size())
-                throw std::runtime_error(std::string("Unable to write to '" + path + "'!").c_str());
-        }
-
-    private:
-        FILE *file;
-        std::string path;
-        unsigned fileSize;
-};
-
-class FPQEncryptor {
-    public:
-        FPQEncryptor() { }
-        FPQEncryptor(std::string key) {
-            if (!key.length() || sizeof(FPQHeader) % key.length())
-                throw std::runtime_error("Error! Encryption key length must be a power of 2!");
-            this->key = key;
-        }
-        FPQEncryptor &operator=(const FPQEncryptor &encryptor) { this->key = encryptor.key; return *this; }
-        
-        std::string getKey(void) const { return key; }
-
-        void encrypt(std::vector<uint8_t> &data) {
-            if (!key.length()) return;
-            auto it = data.begin();
-            while(it != data.end()) {
-                std::transform(key.begin(), key.end(), it, it, [](uint8_t a, uint8_t b) { return a ^ b; });
-                it += key.length();
-            }
-        }
-    private:
-        std::string key;
-};
-
+    return sections;
+}
 
 std::string getCurrentDir(void) {
     std::string currentDir;
@@ -290,30 +146,80 @@ std::string getCurrentDir(void) {
 
 int32_t main(int argc, char *argv[]) {
 
-    PRINT_LONG_CAPTION;
     if (sizeof(FPQHeader) != 512) throw std::runtime_error("Alignment test not passed!");
 
     int opt;
     bool debug = false;
     FPQLog log;
-    FPQHeader header;
     FPQEncryptor encryptor;
     FPQSerial serial(DEFAULT_SERIAL);
     std::map<int,std::string> files;
     std::string outputPath = getCurrentDir() + std::string("/firmware.bin");
     std::ofstream logFile;
-
-    while((opt = getopt(argc, argv, "d:l:c:b:x:s:f:o:k:h:")) != -1) {
+    unsigned bufferMB = DEFAULT_BUFFER_MB;
+    unsigned jobs = 1;
+    FPQBackend backend = FPQBackend::Stdio;
+    FPQOutput output = FPQOutput::Buffered;
+    std::string unpackPath;
+    std::vector<std::string> verifyPaths;
+    std::string serialSpec;
+    std::string updatePath;
+    bool outputSet = false, serialSet = false, checksums = false, manifest = false;
+    std::string statsFormat;
+    std::unique_ptr<FPQStats> stats;
+    std::string cacheDir;
+    uint64_t cacheMB = DEFAULT_CACHE_MB;
+    uint32_t compress = 0;
+    std::string basePath, deltaPath, patchPath;
+    std::string daemonSocket, clientSocket;
+    std::string variantsPath;
+
+    while((opt = getopt(argc, argv, "d:l:c:b:x:s:f:o:k:h:m:j:i:u:v:n:r:t:e:z:a:p:y:g:w:D:S:W:M:V:")) != -1) {
         switch(opt) {
             case 'd': debug = true; break;
-            case 'h': serial = FPQSerial(std::string(optarg)); break;
+            case 'h': serial = FPQSerial(std::string(optarg)); serialSet = true; break;
             case 'k': encryptor = FPQEncryptor(std::string(optarg)); break;
             case 'c': files[FPQHeader::Type::Config] = std::string(optarg); break;
             case 'b': files[FPQHeader::Type::UBoot] = std::string(optarg); break;
             case 'x': files[FPQHeader::Type::Linux] =  std::string(optarg); break;
             case 's': files[FPQHeader::Type::LiteOS] =  std::string(optarg); break;
             case 'f': files[FPQHeader::Type::RootFS] = std::string(optarg); break;
-            case 'o': outputPath = std::string(optarg); break;
+            case 'o':
+                outputPath = std::string(optarg);
+                outputSet = true;
+                if (outputPath == "-") std::cout.rdbuf(std::cerr.rdbuf());  // stdout carries the image
+            break;
+            case 'u': unpackPath = std::string(optarg); break;
+            case 'v': verifyPaths.push_back(std::string(optarg)); break;
+            case 'n': serialSpec = std::string(optarg); break;
+            case 'r': updatePath = std::string(optarg); break;
+            case 'm':
+                bufferMB = std::stoul(std::string(optarg));
+                if (!bufferMB || bufferMB > MAX_BUFFER_MB) throw std::runtime_error("Invalid buffer size!");
+            break;
+            case 'j':
+                jobs = std::stoul(std::string(optarg));
+                if (!jobs) jobs = std::max(1U, std::thread::hardware_concurrency());
+                if (jobs > MAX_JOBS) throw std::runtime_error("Invalid number of jobs!");
+            break;
+            case 'i': backend = parseBackend(std::string(optarg)); break;
+            case 'W': output = parseOutput(std::string(optarg)); break;
+            case 'a': checksums = true; break;
+            case 'M': manifest = true; break;
+            case 'V': variantsPath = std::string(optarg); break;
+            case 'p': compress = parseSections(std::string(optarg)); break;
+            case 'y': basePath = std::string(optarg); break;
+            case 'g': deltaPath = std::string(optarg); break;
+            case 'w': patchPath = std::string(optarg); break;
+            case 'D': daemonSocket = std::string(optarg); break;
+            case 'S': clientSocket = std::string(optarg); break;
+            case 'e': cacheDir = std::string(optarg); break;
+            case 'z': cacheMB = std::stoull(std::string(optarg)); break;
+            case 't':
+                statsFormat = std::string(optarg);
+                if (statsFormat != "table" && statsFormat != "json") throw std::runtime_error("Unknown stats format!");
+                stats.reset(new FPQStats());
+            break;
             case 'l':
                 if (debug) {
                     log("Logging into file...\n");
@@ -322,8 +228,118 @@ int32_t main(int argc, char *argv[]) {
                     log = FPQLog(&logFile);
                 } 
             break;
-            default: printHelp(); return -1; break;
+            default: PRINT_LONG_CAPTION; printHelp(); return -1; break;
+        }
+    }
+
+    if (!clientSocket.empty()) {
+        // the daemon has its own working directory, and stdout carries its answer only
+        auto absolute = [](const std::string &path) { return (path.empty() || path[0] == '/') ? path : getCurrentDir() + "/" + path; };
+        const std::map<int,std::string> names = { { FPQHeader::Type::Config, "c" }, { FPQHeader::Type::UBoot, "b" },
+            { FPQHeader::Type::Linux, "x" }, { FPQHeader::Type::LiteOS, "s" }, { FPQHeader::Type::RootFS, "f" } };
+        std::string line;
+
+        for (int i = optind; i < argc; ++i) verifyPaths.push_back(std::string(argv[i]));
+        if (files.empty() && verifyPaths.size() == 1 && (verifyPaths[0] == "stats" || verifyPaths[0] == "quit")) line = verifyPaths[0];
+        else if (files.empty()) {
+            line = "verify";
+            for (auto &path : verifyPaths) line += "\tv=" + absolute(path);
         }
+        else {
+            line = serialSpec.empty() ? "pack" : "batch\tn=" + serialSpec;
+            line += "\to=" + absolute(serialSpec.empty() || outputSet ? outputPath : getCurrentDir());
+            for (auto &file : files) line += "\t" + names.at(file.first) + "=" + absolute(file.second);
+            if (serialSet) line += "\th=" + serial.getStr();
+            if (checksums) line += "\ta=1";
+        }
+        if (!encryptor.getKey().empty()) line += "\tk=" + encryptor.getKey();
+
+        std::string response = FPQDaemon::request(clientSocket, line);
+        std::cout << response;
+        bool failed = response.empty() || response.find("\"result\":\"error\"") != std::string::npos ||
+                      response.find("\"result\":\"fail\"") != std::string::npos;
+        return failed ? 1 : 0;
+    }
+
+    // verify prints JSON lines only, so that they can be piped into a parser
+    if (!verifyPaths.empty()) {
+        for (int i = optind; i < argc; ++i) verifyPaths.push_back(std::string(argv[i]));
+
+        std::vector<FPQVerifyResult> results(verifyPaths.size());
+        FPQThreadPool threads(jobs);
+        threads.run(verifyPaths.size(), [&](size_t i) { results[i] = verifyImage(encryptor, verifyPaths[i]); });
+
+        bool passed = true;
+        for (auto &result : results) {
+            std::cout << result.toJson() << std::endl;
+            passed = passed && result.passed();
+        }
+        return passed ? 0 : 1;
+    }
+
+    // the JSON report keeps stdout to itself, the caption and the log go to stderr
+    std::ostream report(std::cout.rdbuf());
+    if (statsFormat == "json") std::cout.rdbuf(std::cerr.rdbuf());
+
+    PRINT_LONG_CAPTION;
+
+    std::unique_ptr<FPQCache> cache;
+    if (!cacheDir.empty()) cache.reset(new FPQCache(cacheDir, cacheMB * 1024 * 1024));
+
+    FPQContext ctx = { log, debug, encryptor, bufferMB * 1024 * 1024, jobs, backend, stats.get(), cache.get(), checksums, compress, output, NULL };
+    auto printStats = [&]() {
+        if (!stats) return;
+        if (statsFormat == "json") stats->printJson(report);
+        else stats->print(report);
+    };
+
+    if (!unpackPath.empty()) {
+        std::string outputDir = outputSet ? outputPath : getCurrentDir();
+        if (debug) log("Unpacking '", unpackPath, "' into '", outputDir, "'\n");
+        unpackImage(ctx, unpackPath, outputDir);
+        log("Unpacking done!\n");
+        printStats();
+        return 0;
+    }
+
+    if (!daemonSocket.empty()) {
+        FPQDaemon daemon(ctx, daemonSocket, cacheMB * 1024 * 1024);
+        log(std::dec, "Listening on '", daemonSocket, "', ", std::max(1U, jobs), " worker(s)\n");
+        daemon.run();
+        log("Daemon stopped!\n");
+        return 0;
+    }
+
+    if (!deltaPath.empty() || !patchPath.empty()) {
+        if (basePath.empty()) throw std::runtime_error("Base image is not specified!");
+        if (!deltaPath.empty()) {
+            std::string patch = outputSet ? outputPath : getCurrentDir() + "/firmware.delta";
+            if (debug) log("Patch from '", basePath, "' to '", deltaPath, "' into '", patch, "'\n");
+            uint64_t size = deltaImage(ctx, basePath, deltaPath, patch);
+            log(std::dec, "Delta done, ", size, " bytes!\n");
+        }
+        else {
+            if (debug) log("Applying '", patchPath, "' to '", basePath, "'\n");
+            applyDelta(ctx, basePath, patchPath, outputPath);
+            log("Patching done!\n");
+        }
+        return 0;
+    }
+
+    if (!updatePath.empty()) {
+        if (debug) log("Repacking '", updatePath, "'\n");
+        updateImage(ctx, updatePath, files, serialSet ? &serial : NULL);
+        log("Repacking done!\n");
+        return 0;
+    }
+
+    if (!variantsPath.empty()) {
+        std::vector<FPQVariant> variants = parseVariants(variantsPath, { "", files, encryptor, serial });
+        if (debug) log(std::dec, "Building ", variants.size(), " variant(s) from '", variantsPath, "', jobs: ", jobs, "\n");
+        buildVariants(ctx, variants);
+        log("Packaging done!\n");
+        printStats();
+        return 0;
     }
 
     if (!files.count(FPQHeader::Type::Config)) {
@@ -333,54 +349,43 @@ int32_t main(int argc, char *argv[]) {
     }
 
     if (debug) log("Output file: '", outputPath, "'\n");
-    if (debug) log("Using encryption key: '", encryptor.getKey(), "'\n");
+    if (debug) log("Using encryption key: '", encryptor.getKey(), "' (", FPQEncryptor::getKernel(), ")\n");
     if (debug) {
         log ("Serial number: '", serial.getStr(), "'");
         log (std::hex, " --- [0x", serial.get(),"]\n");
     }
 
-    FPQFile output(outputPath, FPQFile::OpenMode::RWCreate);
-    output.setPos(FPQHeader::blkSize());
+    if (debug) log(std::dec, "I/O buffer size: ", bufferMB, " MB, jobs: ", jobs, "\n");
+    if (debug) log("CRC32 kernel: ", CRC32_KernelName(), "\n");
 
-    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
-        if (i == FPQHeader::Type::Serial) {
-            if (debug) log(std::dec, FPQHeader::getName(i), " size is ", FPQHeader::blkSize(), " bytes, blocks: 1\n");
-            std::vector<uint8_t> fileBlock = FPQHeader::makeSerial(serial.get());
-            encryptor.encrypt(fileBlock);
-            output.write(fileBlock);
-            header.setSize((FPQHeader::Type)i, fileBlock.size());
-        }
-        else {
-            if (!files.count(i)) {
-                if (debug) log(FPQHeader::getName(i), " skipping...\n");
-                continue;
-            }
-            
-            FPQFile file(files[i]);
-            int blkToRead = FPQHeader::align(file.size()) / FPQHeader::blkSize(); 
-            if (debug) log(std::dec, FPQHeader::getName(i), " size is ", file.size(), " bytes, blocks: ", blkToRead, "\n");
-
-            for (int blk = 0; blk < blkToRead; ++blk) {
-                std::vector<uint8_t> fileBlock(FPQHeader::blkSize());
-                int bytesRead = blk * FPQHeader::blkSize();
-                int bytesToRead = std::min(file.size() - bytesRead, FPQHeader::blkSize());
-        
-                file.read(fileBlock.data(), bytesToRead);
-                encryptor.encrypt(fileBlock);
-                output.write(fileBlock);
-            }
-            header.setSize((FPQHeader::Type)i, file.size());
-        }
+    std::unique_ptr<FPQDigester> digester;
+    if (manifest) {
+        if (outputPath == "-") throw std::runtime_error("The manifest goes next to the output, stdout has none!");
+        digester.reset(new FPQDigester(std::max(2U, jobs), stats.get()));
+        ctx.digests = digester.get();
+        if (debug) log("SHA-256 kernel: ", FPQDigester::kernelName(), "\n");
     }
 
-    header.updateOffsets();
-    if (debug) header.dumpLog(log);
-
-    output.setPos(0L);
-    std::vector<uint8_t> headerBlk(header.begin(), header.end());
-    encryptor.encrypt(headerBlk);
-    output.write(headerBlk);
+    if (!serialSpec.empty()) {
+        if (isStreamed(files, "")) throw std::runtime_error("Batch mode needs regular firmware files!");
+        std::vector<FPQSerial> serials = parseSerials(serialSpec);
+        std::string outputDir = outputSet ? outputPath : getCurrentDir();
+        if (debug) log(std::dec, "Batch of ", serials.size(), " image(s) into '", outputDir, "'\n");
+        batchImages(ctx, files, serials, outputDir);
+    }
+    else if (isStreamed(files, output == FPQOutput::Buffered ? outputPath : "")) {     // direct output may be a block device
+        if (debug) log("Streaming without seeking\n");
+        streamImage(ctx, files, serial.get(), outputPath);
+    }
+    else {
+        packImage(ctx, files, serial.get(), outputPath);
+    }
+    if (digester) {
+        digester->writeManifest(outputPath + ".sha256");
+        if (debug) log("Digests written to '", outputPath, ".sha256'\n");
+    }
 
     log("Packaging done!\n");
+    printStats();
     return 0;
 }
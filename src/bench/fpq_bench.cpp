@@ -0,0 +1,317 @@
+/*
+* 	File: fpq_bench.cpp
+* 	Brief: Throughput benchmarks for CRC32, encryption, compression and packing
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include "fpqpack.h"
+#include "lz.h"
+
+#ifdef _WIN32
+    #include "getopt.h"
+#else
+    #include <getopt.h>
+#endif
+
+#define DEFAULT_SIZES         "1,16,256"
+#define DEFAULT_TOTAL_MB      256
+#define DEFAULT_REPEATS       3
+#define DEFAULT_TOLERANCE     10
+#define MAX_SECTION_MB        4095      // offsets in FPQHeader are 32 bit
+
+
+void printHelp() {
+    std::cout << "Usage: fpq_bench [-s] [section sizes, MB] [-t] [bytes per memory test, MB] [-r] [repeats]" << std::endl;
+    std::cout << "                 [-w] [work dir] [-o] [results json] [-b] [baseline json] [-p] [tolerance, %]" << std::endl << std::endl;
+    std::cout << "Measures CRC32, encryption, compression and end-to-end pack throughput." << std::endl;
+    std::cout << "\t -s, \tcomma separated synthetic section sizes, 1.." << MAX_SECTION_MB << " (default: " << DEFAULT_SIZES << ")" << std::endl;
+    std::cout << "\t -t, \tdata processed by each CRC32/encryption test (default: " << DEFAULT_TOTAL_MB << ")" << std::endl;
+    std::cout << "\t -r, \trepeats, the best run is reported (default: " << DEFAULT_REPEATS << ")" << std::endl;
+    std::cout << "\t -w, \tdirectory for synthetic files (default: current)" << std::endl;
+    std::cout << "\t -o, \twrite results as JSON" << std::endl;
+    std::cout << "\t -b, \tcompare with a baseline JSON, exit code 1 on regression" << std::endl;
+    std::cout << "\t -p, \tallowed slowdown against the baseline (default: " << DEFAULT_TOLERANCE << ")" << std::endl << std::endl;
+}
+
+class FPQBench {
+    public:
+        FPQBench(unsigned repeats) : repeats(repeats ? repeats : 1) { }
+
+        /* Runs fn 'repeats' times, records the best throughput for 'bytes' processed per run
+         * and, for codecs, the compressed to raw size ratio */
+        void measure(const std::string &name, uint64_t bytes, const std::function<void(void)> &fn, double ratio = 0) {
+            double best = 0;
+            for (unsigned i = 0; i < repeats; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                fn();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::max(best, bytes / (1024.0 * 1024.0) / std::max(elapsed.count(), 1e-9));
+            }
+            results.push_back({ name, best, ratio });
+            if (ratio) printf("%-52s %10.1f MB/s, ratio %.3f\n", name.c_str(), best, ratio);
+            else printf("%-52s %10.1f MB/s\n", name.c_str(), best);
+            fflush(stdout);
+        }
+
+        void writeJson(const std::string &path) const {
+            std::ofstream json(path);
+            if (!json.is_open()) throw std::runtime_error(std::string("Unable to create '" + path + "'!").c_str());
+            json << "{\"results\":[\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                json << "  {\"name\":\"" << results[i].name << "\",\"mbps\":" << results[i].mbps;
+                if (results[i].ratio) json << ",\"ratio\":" << results[i].ratio;
+                json << "}";
+                json << (i + 1 < results.size() ? ",\n" : "\n");
+            }
+            json << "]}\n";
+        }
+
+        // Reads back what writeJson() produces
+        static std::map<std::string,double> readJson(const std::string &path) {
+            std::ifstream json(path);
+            if (!json.is_open()) throw std::runtime_error(std::string("Unable open '" + path + "'!").c_str());
+            std::stringstream text;
+            text << json.rdbuf();
+
+            std::map<std::string,double> values;
+            std::string str = text.str(), nameKey = "\"name\":\"", mbpsKey = "\"mbps\":";
+            for (size_t pos = str.find(nameKey); pos != std::string::npos; pos = str.find(nameKey, pos)) {
+                pos += nameKey.length();
+                size_t end = str.find('"', pos), value = str.find(mbpsKey, end);
+                if (end == std::string::npos || value == std::string::npos) break;
+                values[str.substr(pos, end - pos)] = std::stod(str.substr(value + mbpsKey.length()));
+            }
+            return values;
+        }
+
+        // Prints every result slower than the baseline by more than 'tolerance' percent
+        bool compare(const std::map<std::string,double> &baseline, unsigned tolerance) const {
+            bool passed = true;
+            for (auto &result : results) {
+                auto base = baseline.find(result.name);
+                if (base == baseline.end()) continue;
+                if (result.mbps < base->second * (100 - tolerance) / 100) {
+                    printf("REGRESSION %s: %.1f MB/s, baseline %.1f MB/s\n", result.name.c_str(), result.mbps, base->second);
+                    passed = false;
+                }
+            }
+            return passed;
+        }
+
+    private:
+        struct Result { std::string name; double mbps, ratio; };
+
+        unsigned repeats;
+        std::vector<Result> results;
+};
+
+static void fillRandom(uint8_t *data, size_t size, uint64_t &state) {
+    for (size_t i = 0; i < size; ++i) {
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        data[i] = (uint8_t)state;
+    }
+}
+
+// Words picked at random: compresses about like logs, scripts and configs
+static void fillText(uint8_t *data, size_t size, uint64_t &state) {
+    static const char *words[] = { "firmware ", "config ", "kernel ", "rootfs ", "uboot ", "serial ", "image ",
+                                   "section=", "offset ", "0x0200\n", "enable ", "disable\n", "# ", "/dev/mtd" };
+    for (size_t i = 0; i < size; ) {
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        const char *word = words[state % (sizeof(words) / sizeof(words[0]))];
+        for (; *word && i < size; ++word) data[i++] = *word;
+    }
+}
+
+// Random runs between zero filled gaps, like padded flash partitions
+static void fillSparse(uint8_t *data, size_t size, uint64_t &state) {
+    for (size_t i = 0; i < size; i += 4096) {
+        size_t run = std::min<size_t>(size - i, 4096);
+        if (i % (4 * 4096)) std::fill(data + i, data + i + run, 0);
+        else fillRandom(data + i, run, state);
+    }
+}
+
+static std::string makeSection(const std::string &dir, const std::string &name, unsigned sizeMB) {
+    std::string path = dir + "/fpq_bench_" + name + ".bin";
+    FPQFile file(path, FPQFile::OpenMode::RWCreate);
+    FPQBuffer buffer(1024 * 1024);
+    uint64_t state = 0x9E3779B97F4A7C15ULL + sizeMB;
+    for (unsigned i = 0; i < sizeMB; ++i) {
+        fillRandom(buffer.data(), buffer.size(), state);
+        file.write(buffer.data(), buffer.size());
+    }
+    return path;
+}
+
+static std::string sizeName(size_t bytes) {
+    return (bytes >= 1024 * 1024) ? std::to_string(bytes / (1024 * 1024)) + "MB" : std::to_string(bytes / 1024) + "KB";
+}
+
+int32_t main(int argc, char *argv[]) {
+    int opt;
+    std::string sizesStr(DEFAULT_SIZES), workDir("."), jsonPath, baselinePath;
+    unsigned totalMB = DEFAULT_TOTAL_MB, repeats = DEFAULT_REPEATS, tolerance = DEFAULT_TOLERANCE;
+
+    while((opt = getopt(argc, argv, "s:t:r:w:o:b:p:")) != -1) {
+        switch(opt) {
+            case 's': sizesStr = std::string(optarg); break;
+            case 't': totalMB = std::stoul(std::string(optarg)); break;
+            case 'r': repeats = std::stoul(std::string(optarg)); break;
+            case 'w': workDir = std::string(optarg); break;
+            case 'o': jsonPath = std::string(optarg); break;
+            case 'b': baselinePath = std::string(optarg); break;
+            case 'p': tolerance = std::min(100UL, std::stoul(std::string(optarg))); break;
+            default: printHelp(); return -1; break;
+        }
+    }
+
+    std::vector<unsigned> sizes;
+    std::stringstream sizesList(sizesStr);
+    for (std::string item; std::getline(sizesList, item, ','); ) {
+        unsigned sizeMB = std::stoul(item);
+        if (!sizeMB || sizeMB > MAX_SECTION_MB) throw std::runtime_error("Invalid section size!");
+        sizes.push_back(sizeMB);
+    }
+
+    FPQBench bench(repeats);
+    uint64_t total = (uint64_t)std::max(1U, totalMB) * 1024 * 1024;
+    unsigned cpus = std::max(1U, std::thread::hardware_concurrency());
+    std::cout << "CRC32 kernel: " << CRC32_KernelName() << ", XOR kernel: " << FPQEncryptor::getKernel()
+              << ", CPUs: " << cpus << std::endl;
+
+    // Memory bound kernels
+    const std::vector<size_t> bufSizes = { 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+    FPQBuffer data(bufSizes.back());
+    uint64_t state = 1;
+    fillRandom(data.data(), data.size(), state);
+
+    for (size_t bufSize : bufSizes) {
+        volatile uint32_t sink = 0;
+        bench.measure("crc32/buf=" + sizeName(bufSize), total, [&]() {
+            for (uint64_t done = 0; done < total; done += bufSize) sink = sink ^ CRC32_Calculate(data.data(), bufSize);
+        });
+    }
+
+    for (size_t keyLen : { 1, 4, 16, 64, 512 }) {
+        FPQEncryptor encryptor(std::string(keyLen, 'k'));
+        for (size_t bufSize : bufSizes) {
+            bench.measure("encrypt/key=" + std::to_string(keyLen) + "/buf=" + sizeName(bufSize), total, [&]() {
+                for (uint64_t done = 0; done < total; done += bufSize) encryptor.encrypt(data.data(), bufSize);
+            });
+        }
+    }
+
+    // Codec, in the chunks FPQCompressor uses, over data that compresses badly, well and very well
+    struct CodecCase { const char *data; void (*fill)(uint8_t*, size_t, uint64_t&); };
+    const std::vector<CodecCase> codecCases = { { "random", fillRandom }, { "text", fillText }, { "sparse", fillSparse } };
+    const size_t chunk = FPQ_LZ_CHUNK_SIZE;
+    FPQBuffer packed(LZ_Bound(chunk) * (data.size() / chunk)), unpacked(chunk);
+    for (auto &c : codecCases) {
+        state = 1;
+        c.fill(data.data(), data.size(), state);
+        std::vector<size_t> packedSizes(data.size() / chunk);
+        auto compress = [&]() {
+            for (size_t i = 0; i < packedSizes.size(); ++i)
+                packedSizes[i] = LZ_Compress(packed.data() + i * LZ_Bound(chunk), LZ_Bound(chunk), data.data() + i * chunk, chunk);
+        };
+        compress();
+        double ratio = 0;
+        for (size_t size : packedSizes) ratio += (double)size / data.size();
+
+        bench.measure(std::string("lz/compress/data=") + c.data, total, [&]() {
+            for (uint64_t done = 0; done < total; done += data.size()) compress();
+        }, ratio);
+        bench.measure(std::string("lz/decompress/data=") + c.data, total, [&]() {
+            for (uint64_t done = 0; done < total; done += data.size())
+                for (size_t i = 0; i < packedSizes.size(); ++i)
+                    if (LZ_Decompress(unpacked.data(), chunk, packed.data() + i * LZ_Bound(chunk), packedSizes[i]) != (int64_t)chunk)
+                        throw std::runtime_error("Decompression failed!");
+        }, ratio);
+    }
+
+    // End to end: a small config plus one large section, warm page cache
+    // jobs == 0 means one per CPU, the result names stay the same across machines
+    // the lz case packs random data, so it shows what compression costs when it does not pay off
+    struct PackCase { unsigned bufferMB; unsigned jobs; FPQBackend backend; const char *io; bool lz; };
+    const std::vector<PackCase> cases = {
+        { 1, 1, FPQBackend::Stdio, "stdio", false }, { 4, 1, FPQBackend::Stdio, "stdio", false },
+        { 16, 1, FPQBackend::Stdio, "stdio", false }, { 4, 0, FPQBackend::Stdio, "stdio", false },
+        { 4, 0, FPQBackend::Mmap, "mmap", false }, { 4, 0, FPQBackend::Uring, "uring", false },
+        { 4, 0, FPQBackend::Stdio, "stdio", true },
+    };
+    std::ofstream devNull;
+    FPQLog log(&devNull);
+    std::string configPath = makeSection(workDir, "config", 1), outputPath = workDir + "/fpq_bench_out.bin";
+
+    for (unsigned sizeMB : sizes) {
+        std::map<int,std::string> files = { { FPQHeader::Type::Config, configPath },
+                                            { FPQHeader::Type::RootFS, makeSection(workDir, std::to_string(sizeMB) + "MB", sizeMB) } };
+        for (auto &c : cases) {
+            FPQContext ctx = { log, false, FPQEncryptor("0123456789abcdef"), c.bufferMB * 1024 * 1024,
+                               c.jobs ? c.jobs : cpus, c.backend, NULL, NULL, false,
+                               c.lz ? 1U << FPQHeader::Type::RootFS : 0, FPQOutput::Buffered, NULL };
+            std::string name = "pack/size=" + std::to_string(sizeMB) + "MB/buf=" + std::to_string(c.bufferMB) + "MB/jobs=" +
+                               (c.jobs ? std::to_string(c.jobs) : std::string("all")) + "/io=" + c.io + (c.lz ? "/lz" : "");
+            bench.measure(name, (uint64_t)sizeMB * 1024 * 1024, [&]() { packImage(ctx, files, 0xB00B0069, outputPath); });
+        }
+
+        // No key: the sections are copied in the kernel
+        {
+            FPQContext ctx = { log, false, FPQEncryptor(), 4 * 1024 * 1024, 1, FPQBackend::Stdio, NULL, NULL, false, 0,
+                               FPQOutput::Buffered, NULL };
+            bench.measure("pack/size=" + std::to_string(sizeMB) + "MB/nokey", (uint64_t)sizeMB * 1024 * 1024,
+                          [&]() { packImage(ctx, files, 0xB00B0069, outputPath); });
+        }
+
+        // Random 4 KB reads from the RootFS of a packed image, reader opened once per round
+        {
+            FPQContext ctx = { log, false, FPQEncryptor("0123456789abcdef"), 4 * 1024 * 1024, 1, FPQBackend::Stdio, NULL, NULL,
+                               false, 0, FPQOutput::Buffered, NULL };
+            packImage(ctx, files, 0xB00B0069, outputPath);
+            const unsigned reads = 1024, readSize = 4096;
+            std::vector<uint8_t> data(readSize);
+            bench.measure("reader/size=" + std::to_string(sizeMB) + "MB/read=4KB", (uint64_t)reads * readSize, [&]() {
+                FPQReader reader(outputPath, ctx.encryptor);
+                FPQReader::View rootfs = reader.section(FPQHeader::Type::RootFS);
+                for (unsigned i = 0; i < reads; ++i) {
+                    uint64_t offset = (i * 2654435761ULL) % (rootfs.size() - readSize + 1);
+                    rootfs.readAt(data.data(), readSize, offset);
+                }
+            });
+        }
+
+        // Build matrix: the same inputs under four keys, bytes are the total of the images
+        std::vector<FPQVariant> variants;
+        for (unsigned v = 0; v < 4; ++v) {
+            variants.push_back({ workDir + "/fpq_bench_variant" + std::to_string(v) + ".bin", files,
+                                 FPQEncryptor(std::string("variant-key-000") + char('0' + v)), FPQSerial() });
+        }
+        FPQContext ctx = { log, false, FPQEncryptor(), 4 * 1024 * 1024, cpus, FPQBackend::Stdio, NULL, NULL, false, 0,
+                           FPQOutput::Buffered, NULL };
+        bench.measure("matrix/size=" + std::to_string(sizeMB) + "MB/variants=" + std::to_string(variants.size()),
+                      (uint64_t)sizeMB * 1024 * 1024 * variants.size(), [&]() { buildVariants(ctx, variants); });
+        for (auto &variant : variants) remove(variant.output.c_str());
+        remove(files[FPQHeader::Type::RootFS].c_str());
+    }
+    remove(configPath.c_str());
+    remove(outputPath.c_str());
+
+    if (!jsonPath.empty()) bench.writeJson(jsonPath);
+    if (!baselinePath.empty()) {
+        if (!bench.compare(FPQBench::readJson(baselinePath), tolerance)) return 1;
+        std::cout << "No regressions against '" << baselinePath << "'" << std::endl;
+    }
+    return 0;
+}
@@ -15,13 +15,27 @@
 *	Check : 0xCBF43926 ("123456789")
 *	MaxLen: 268 435 455 байт (2 147 483 647 бит) - обнаружение
 *		одинарных, двойных, пакетных и всех нечетных ошибок
+*
+*	Update runs PCLMULQDQ folding (4 x 128 bit lanes, Barrett reduction)
+*	when the CPU has it, otherwise slicing-by-16/8 over tables derived
+*	from crc32_table. Combine multiplies crc1 by x^(8 * size2) mod P.
 */
 #ifdef __cplusplus
 extern "C" {  
 #endif
 
+#include <pthread.h>
 #include "crc32.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define CRC32_X86
+	#include <immintrin.h>
+#endif
+
+#define CRC32_POLY		0xEDB88320
+#define CRC32_SLICES		16
+#define CRC32_FOLD_MIN		64
+
 
 static const uint32_t crc32_table[256] = {
 	0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
@@ -91,17 +105,238 @@ static const uint32_t crc32_table[256] = {
 };
 
 
-uint32_t CRC32_Calculate(const uint8_t *data, int32_t size) {
+typedef uint32_t (*crc32_kernel_t)(uint32_t, const uint8_t *, size_t);
+
+static uint32_t crc32_slice[CRC32_SLICES][256];
+static uint32_t crc32_x2n[32];
+static crc32_kernel_t crc32_kernel = NULL;
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+static const char *crc32_kernel_name = "slice16";
+
+
+static uint32_t crc32_le32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *data, size_t size) {
+
+	const uint32_t (*t)[256] = crc32_slice;
+
+	while (size >= 16) {
+		uint32_t w0 = crc32_le32(data) ^ crc;
+		uint32_t w1 = crc32_le32(data + 4);
+		uint32_t w2 = crc32_le32(data + 8);
+		uint32_t w3 = crc32_le32(data + 12);
 
-	uint32_t crc = 0xFFFFFFFF;
+		crc = t[15][w0 & 0xFF] ^ t[14][(w0 >> 8) & 0xFF] ^ t[13][(w0 >> 16) & 0xFF] ^ t[12][w0 >> 24] ^
+		      t[11][w1 & 0xFF] ^ t[10][(w1 >> 8) & 0xFF] ^ t[9][(w1 >> 16) & 0xFF] ^ t[8][w1 >> 24] ^
+		      t[7][w2 & 0xFF] ^ t[6][(w2 >> 8) & 0xFF] ^ t[5][(w2 >> 16) & 0xFF] ^ t[4][w2 >> 24] ^
+		      t[3][w3 & 0xFF] ^ t[2][(w3 >> 8) & 0xFF] ^ t[1][(w3 >> 16) & 0xFF] ^ t[0][w3 >> 24];
+
+		data += 16;
+		size -= 16;
+	}
+
+	if (size >= 8) {
+		uint32_t w0 = crc32_le32(data) ^ crc;
+		uint32_t w1 = crc32_le32(data + 4);
+
+		crc = t[7][w0 & 0xFF] ^ t[6][(w0 >> 8) & 0xFF] ^ t[5][(w0 >> 16) & 0xFF] ^ t[4][w0 >> 24] ^
+		      t[3][w1 & 0xFF] ^ t[2][(w1 >> 8) & 0xFF] ^ t[1][(w1 >> 16) & 0xFF] ^ t[0][w1 >> 24];
+
+		data += 8;
+		size -= 8;
+	}
 
 	while (size--) {
 		crc = (crc >> 8) ^ crc32_table[(crc ^ *data++) & 0xFF];
 	}
 
+	return crc;
+}
+
+#ifdef CRC32_X86
+
+/* Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"; size >= 64, size % 16 == 0 */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_fold(uint32_t crc, const uint8_t *data, size_t size) {
+
+	const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+	const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, y1, y2, y3, y4;
+
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 16));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 32));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 48));
+	data += 64;
+	size -= 64;
+
+	while (size >= 64) {
+		y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), _mm_loadu_si128((const __m128i *)data));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, y2), _mm_loadu_si128((const __m128i *)(data + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, y3), _mm_loadu_si128((const __m128i *)(data + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, y4), _mm_loadu_si128((const __m128i *)(data + 48)));
+
+		data += 64;
+		size -= 64;
+	}
+
+	/* Fold the four lanes into one */
+	y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), y1);
+	y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), y1);
+	y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), y1);
+
+	while (size >= 16) {
+		y1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), _mm_loadu_si128((const __m128i *)data));
+		data += 16;
+		size -= 16;
+	}
+
+	/* 128 -> 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *data, size_t size) {
+
+	if (size >= CRC32_FOLD_MIN) {
+		size_t chunk = size & ~(size_t)15;
+		crc = crc32_fold(crc, data, chunk);
+		data += chunk;
+		size -= chunk;
+	}
+
+	return crc32_slice16(crc, data, size);
+}
+
+#endif /* CRC32_X86 */
+
+
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b) {
+
+	uint32_t m = (uint32_t)1 << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+
+	return p;
+}
+
+/* Runs once through pthread_once(): the first call may come from any worker thread */
+static void crc32_resolve(void) {
+
+	crc32_kernel_t kernel = crc32_slice16;
+
+	for (int i = 0; i < 256; i++) {
+		crc32_slice[0][i] = crc32_table[i];
+	}
+	for (int k = 1; k < CRC32_SLICES; k++) {
+		for (int i = 0; i < 256; i++) {
+			uint32_t prev = crc32_slice[k - 1][i];
+			crc32_slice[k][i] = (prev >> 8) ^ crc32_table[prev & 0xFF];
+		}
+	}
+
+	/* crc32_x2n[k] = x^(2^k) mod P */
+	crc32_x2n[0] = (uint32_t)1 << 30;
+	for (int k = 1; k < 32; k++) {
+		crc32_x2n[k] = crc32_multmodp(crc32_x2n[k - 1], crc32_x2n[k - 1]);
+	}
+
+#ifdef CRC32_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		kernel = crc32_pclmul;
+		crc32_kernel_name = "pclmul";
+	}
+#endif
+
+	crc32_kernel = kernel;
+}
+
+
+uint32_t CRC32_Init(void) {
+
+	pthread_once(&crc32_once, crc32_resolve);
+	return 0xFFFFFFFF;
+}
+
+uint32_t CRC32_Update(uint32_t crc, const uint8_t *data, size_t size) {
+
+	pthread_once(&crc32_once, crc32_resolve);
+	return crc32_kernel(crc, data, size);
+}
+
+uint32_t CRC32_Final(uint32_t crc) {
 	return crc ^ 0xFFFFFFFF;
 }
 
+uint32_t CRC32_Combine(uint32_t crc1, uint32_t crc2, uint64_t size2) {
+
+	uint32_t p = (uint32_t)1 << 31;
+	unsigned k = 3;
+
+	pthread_once(&crc32_once, crc32_resolve);
+
+	/* p = x^(8 * size2) mod P */
+	while (size2) {
+		if (size2 & 1) p = crc32_multmodp(crc32_x2n[k & 31], p);
+		size2 >>= 1;
+		k++;
+	}
+
+	return crc32_multmodp(p, crc1) ^ crc2;
+}
+
+uint32_t CRC32_Calculate(const uint8_t *data, int32_t size) {
+
+	if (size <= 0) return 0;
+	return CRC32_Final(CRC32_Update(CRC32_Init(), data, (size_t)size));
+}
+
+const char *CRC32_KernelName(void) {
+
+	pthread_once(&crc32_once, crc32_resolve);
+	return crc32_kernel_name;
+}
+
 
 #ifdef __cplusplus  
 } // extern "C"  
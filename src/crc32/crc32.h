@@ -13,10 +13,21 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 
 
 uint32_t CRC32_Calculate(const uint8_t *data, int32_t size);
 
+/* Streaming interface: crc = CRC32_Final(CRC32_Update(CRC32_Init(), data, size)) */
+uint32_t CRC32_Init(void);
+uint32_t CRC32_Update(uint32_t crc, const uint8_t *data, size_t size);
+uint32_t CRC32_Final(uint32_t crc);
+
+/* CRC of A|B from final CRCs of A and B, where B is 'size2' bytes long */
+uint32_t CRC32_Combine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
+const char *CRC32_KernelName(void);
+
 
 #ifdef __cplusplus  
 } // extern "C"  
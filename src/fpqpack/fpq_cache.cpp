@@ -0,0 +1,155 @@
+/*
+* 	File: fpq_cache.cpp
+* 	Brief: Encrypted section cache implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "fpq_cache.h"
+#include "crc32.h"
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <sys/utime.h>
+    #include <sys/stat.h>
+#else
+    #include <unistd.h>
+    #include <dirent.h>
+    #include <utime.h>
+    #include <sys/stat.h>
+#endif
+
+#define CACHE_HASH_CHUNK    (1024 * 1024)   // content hash is chained per chunk, independent of the buffer size
+
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t load64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+static inline uint32_t load32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+// XXH64
+uint64_t FPQCache::hash64(const uint8_t *data, size_t size, uint64_t seed) {
+    const uint64_t p1 = 11400714785074694791ULL, p2 = 14029467366897019727ULL, p3 = 1609587929392839161ULL;
+    const uint64_t p4 = 9650029242287828579ULL, p5 = 2870177450012600261ULL;
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl64(acc + input * p2, 31) * p1; };
+    auto merge = [&](uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * p1 + p4; };
+
+    const uint8_t *end = data + size;
+    uint64_t h;
+    if (size >= 32) {
+        uint64_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+        for (; data + 32 <= end; data += 32) {
+            v1 = round(v1, load64(data));
+            v2 = round(v2, load64(data + 8));
+            v3 = round(v3, load64(data + 16));
+            v4 = round(v4, load64(data + 24));
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    }
+    else h = seed + p5;
+
+    h += size;
+    for (; data + 8 <= end; data += 8) h = rotl64(h ^ round(0, load64(data)), 27) * p1 + p4;
+    if (data + 4 <= end) { h = rotl64(h ^ (load32(data) * p1), 23) * p2 + p3; data += 4; }
+    for (; data < end; ++data) h = rotl64(h ^ (*data * p5), 11) * p1;
+
+    h ^= h >> 33; h *= p2;
+    h ^= h >> 29; h *= p3;
+    h ^= h >> 32;
+    return h;
+}
+
+FPQCache::FPQCache(const std::string &dir, uint64_t maxBytes) : dir(dir), maxBytes(maxBytes) {
+    makeDir(dir);
+}
+
+std::string FPQCache::key(FPQFile &input, const FPQEncryptor &encryptor, FPQBuffer &buffer, uint32_t *crc) const {
+    std::string key = encryptor.getKey();
+    uint64_t hash = hash64((const uint8_t*)key.data(), key.size(), 0);
+    uint32_t state = CRC32_Init();
+
+    for (uint64_t pos = 0; pos < input.size(); pos += buffer.size()) {
+        size_t size = std::min<uint64_t>(input.size() - pos, buffer.size());
+        input.readAt(buffer.data(), size, pos);
+        for (size_t chunk = 0; chunk < size; chunk += CACHE_HASH_CHUNK) {
+            hash = hash64(buffer.data() + chunk, std::min<size_t>(size - chunk, CACHE_HASH_CHUNK), hash);
+        }
+        state = CRC32_Update(state, buffer.data(), size);
+    }
+
+    if (crc) *crc = CRC32_Final(state);
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx%08x-%u", (unsigned long long)hash, CRC32_Final(state), input.size());
+    return std::string(name);
+}
+
+std::string FPQCache::fetch(const std::string &key, FPQFile &output, uint64_t offset, uint32_t size, FPQBuffer &buffer) {
+    std::string path = entryPath(key);
+    uint64_t cachedSize;
+    if (!regularFileSize(path, cachedSize) || cachedSize != size) return "";
+
+    std::string method;
+    try {
+        FPQFile cached(path, FPQFile::OpenMode::ROpen);
+        method = output.copyRange(cached, 0, size, offset, buffer);
+    }
+    catch (const std::exception &) {
+        return "";      // evicted by another pack in the meantime
+    }
+    utime(path.c_str(), NULL);
+    return method;
+}
+
+void FPQCache::store(const std::string &key, FPQFile &output, uint64_t offset, uint32_t size, FPQBuffer &buffer) {
+    std::string path = entryPath(key);
+    std::string tmpPath = tempPath(path);
+    {
+        FPQFile entry(tmpPath, FPQFile::OpenMode::RWCreate);
+        entry.copyRange(output, offset, size, 0, buffer);
+    }
+    if (rename(tmpPath.c_str(), path.c_str())) remove(tmpPath.c_str());
+
+    std::lock_guard<std::mutex> guard(lock);
+    evict();
+}
+
+void FPQCache::evict(void) {
+    struct Entry { std::string path; uint64_t size; int64_t used; };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    auto addEntry = [&](const std::string &name) {
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".enc")) return;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st)) return;
+        entries.push_back({ path, (uint64_t)st.st_size, (int64_t)st.st_mtime });
+        total += st.st_size;
+    };
+
+    #ifdef _WIN32
+        struct _finddata_t found;
+        intptr_t handle = _findfirst((dir + "/*.enc").c_str(), &found);
+        if (handle != -1) {
+            do addEntry(found.name); while (!_findnext(handle, &found));
+            _findclose(handle);
+        }
+    #else
+        DIR *listing = opendir(dir.c_str());
+        if (!listing) return;
+        while (struct dirent *ent = readdir(listing)) addEntry(ent->d_name);
+        closedir(listing);
+    #endif
+
+    if (total <= maxBytes) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+    for (auto &entry : entries) {
+        if (total <= maxBytes) break;
+        if (!remove(entry.path.c_str())) total -= entry.size;
+    }
+}
@@ -0,0 +1,49 @@
+/*
+* 	File: fpq_cache.h
+* 	Brief: Persistent content-addressed cache of encrypted sections
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_CACHE_H__
+#define __FPQ_CACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include "fpq_format.h"
+#include "fpq_io.h"
+
+#define DEFAULT_CACHE_MB     1024
+
+/* One file per section, named after a hash of the plain input and the
+ * key, holding the encrypted bytes padded to the block size exactly as
+ * they appear in an image. Entries are written under a temporary name
+ * and renamed, so concurrent packs can share a directory. The file
+ * modification time is the last use, the oldest entries are removed
+ * once the directory grows past the size cap. */
+class FPQCache {
+    public:
+        FPQCache(const std::string &dir, uint64_t maxBytes);
+
+        // Cache key of a section: 64-bit content hash and CRC32 seeded by the key, plus the size; crc gets the plain CRC32
+        std::string key(FPQFile &input, const FPQEncryptor &encryptor, FPQBuffer &buffer, uint32_t *crc = NULL) const;
+
+        // Copies the cached section into output at offset, returns the copy method or "" on a miss
+        std::string fetch(const std::string &key, FPQFile &output, uint64_t offset, uint32_t size, FPQBuffer &buffer);
+
+        // Saves 'size' bytes of output at offset as the given key, then evicts down to the size cap
+        void store(const std::string &key, FPQFile &output, uint64_t offset, uint32_t size, FPQBuffer &buffer);
+
+        static uint64_t hash64(const uint8_t *data, size_t size, uint64_t seed);
+
+    private:
+        std::string entryPath(const std::string &key) const { return dir + "/" + key + ".enc"; }
+        void evict(void);
+
+        std::string dir;
+        uint64_t maxBytes;
+        std::mutex lock;
+};
+
+#endif /* __FPQ_CACHE_H__ */
@@ -0,0 +1,117 @@
+/*
+* 	File: fpq_compress.cpp
+* 	Brief: Optional per-section compression implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <cstring>
+#include "fpq_compress.h"
+#include "lz.h"
+
+// magic, raw size, chunk size, chunk count
+static const uint64_t headerWords = 4;
+
+
+FPQCompressor::FPQCompressor(FPQThreadPool &threads, FPQStats *stats, size_t chunkSize)
+    : threads(threads), stats(stats), chunkSize(chunkSize) {
+    if (!chunkSize || chunkSize > maxChunkSize) throw std::runtime_error("Invalid compression chunk size!");
+}
+
+uint64_t FPQCompressor::compress(FPQFile &input, FPQFile &output, int section,
+                                 const std::function<void(const uint8_t*, size_t)> &consume) {
+    uint64_t rawSize = input.size();
+    uint32_t count = (rawSize + chunkSize - 1) / chunkSize;
+    std::vector<uint32_t> table = { magic, (uint32_t)rawSize, (uint32_t)chunkSize, count };
+    table.resize(headerWords + count);
+    uint64_t outPos = table.size() * sizeof(uint32_t);
+
+    // one raw and one packed buffer per thread, reused by every batch
+    std::vector<std::unique_ptr<FPQBuffer>> raw, packed;
+    for (unsigned t = 0; t < std::min<uint32_t>(threads.size(), count); ++t) {
+        raw.emplace_back(new FPQBuffer(chunkSize));
+        packed.emplace_back(new FPQBuffer(LZ_Bound(chunkSize)));
+    }
+
+    for (uint32_t base = 0; base < count; base += raw.size()) {
+        uint32_t batch = std::min<uint32_t>(count - base, raw.size());
+        threads.run(batch, [&](size_t i) {
+            uint64_t pos = (uint64_t)(base + i) * chunkSize;
+            size_t size = std::min<uint64_t>(rawSize - pos, chunkSize);
+            {
+                FPQStats::Scope scope(stats, section, FPQStats::Read, size);
+                input.readAt(raw[i]->data(), size, pos);
+            }
+            FPQStats::Scope scope(stats, section, FPQStats::Compress, size);
+            size_t packedSize = LZ_Compress(packed[i]->data(), size - 1, raw[i]->data(), size);
+            table[headerWords + base + i] = packedSize ? packedSize : size | storedFlag;
+        });
+
+        for (uint32_t i = 0; i < batch; ++i) {
+            uint32_t entry = table[headerWords + base + i];
+            if (consume) consume(raw[i]->data(), std::min<uint64_t>(rawSize - (uint64_t)(base + i) * chunkSize, chunkSize));
+            FPQBuffer &chunk = (entry & storedFlag) ? *raw[i] : *packed[i];
+            FPQStats::Scope scope(stats, section, FPQStats::Write, entry & ~storedFlag);
+            output.writeAt(chunk.data(), entry & ~storedFlag, outPos);
+            outPos += entry & ~storedFlag;
+        }
+    }
+
+    FPQStats::Scope scope(stats, section, FPQStats::Write, table.size() * sizeof(uint32_t));
+    output.writeAt((const uint8_t*)table.data(), table.size() * sizeof(uint32_t), 0);
+    return outPos;
+}
+
+uint64_t FPQCompressor::decompress(FPQFile &input, uint64_t offset, uint64_t size, FPQFile &output, int section) {
+    auto corrupted = []() { return std::runtime_error("Corrupted compressed section!"); };
+
+    uint32_t head[headerWords];
+    if (size < sizeof(head)) throw corrupted();
+    input.readAt((uint8_t*)head, sizeof(head), offset);
+    uint64_t rawSize = head[1], chunk = head[2], count = head[3];
+    if (head[0] != magic || !chunk || chunk > maxChunkSize || count != (rawSize + chunk - 1) / chunk)
+        throw corrupted();
+    if ((headerWords + count) * sizeof(uint32_t) > size) throw corrupted();
+
+    std::vector<uint32_t> table(count);
+    input.readAt((uint8_t*)table.data(), count * sizeof(uint32_t), offset + sizeof(head));
+    std::vector<uint64_t> positions(count);
+    uint64_t pos = (headerWords + count) * sizeof(uint32_t);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t expected = std::min<uint64_t>(rawSize - i * chunk, chunk);
+        uint32_t length = table[i] & ~storedFlag;
+        if (length > LZ_Bound(expected) || ((table[i] & storedFlag) && length != expected)) throw corrupted();
+        positions[i] = pos;
+        pos += length;
+    }
+    if (pos > size) throw corrupted();
+
+    output.resize(rawSize);
+    std::vector<std::unique_ptr<FPQBuffer>> packed, raw;
+    for (unsigned t = 0; t < std::min<uint64_t>(threads.size(), count); ++t) {
+        packed.emplace_back(new FPQBuffer(LZ_Bound(chunk)));
+        raw.emplace_back(new FPQBuffer(chunk));
+    }
+
+    for (uint64_t base = 0; base < count; base += raw.size()) {
+        threads.run(std::min<uint64_t>(count - base, raw.size()), [&](size_t i) {
+            uint64_t index = base + i;
+            uint64_t expected = std::min<uint64_t>(rawSize - index * chunk, chunk);
+            uint32_t length = table[index] & ~storedFlag;
+            bool stored = table[index] & storedFlag;
+            FPQBuffer &target = stored ? *raw[i] : *packed[i];
+            {
+                FPQStats::Scope scope(stats, section, FPQStats::Read, length);
+                input.readAt(target.data(), length, offset + positions[index]);
+            }
+            if (!stored) {
+                FPQStats::Scope scope(stats, section, FPQStats::Compress, expected);
+                if (LZ_Decompress(raw[i]->data(), expected, packed[i]->data(), length) != (int64_t)expected) throw corrupted();
+            }
+            FPQStats::Scope scope(stats, section, FPQStats::Write, expected);
+            output.writeAt(raw[i]->data(), expected, index * chunk);
+        });
+    }
+
+    return rawSize;
+}
@@ -0,0 +1,48 @@
+/*
+* 	File: fpq_compress.h
+* 	Brief: Optional per-section compression
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_COMPRESS_H__
+#define __FPQ_COMPRESS_H__
+
+#include "fpq_io.h"
+#include "fpq_stats.h"
+
+#define FPQ_LZ_CHUNK_SIZE     (1024 * 1024)
+
+/* A compressed section is a self-describing stream that is then padded
+ * and encrypted like any other section:
+ *
+ *     "FPQZ" | raw size | chunk size | chunk count | chunk sizes | chunks
+ *
+ * 32-bit words in host order like the header. Chunks are independent, so both ways
+ * run on the thread pool, one batch of threads.size() chunks at a time.
+ * A chunk that does not shrink is stored as is and flagged by the top bit
+ * of its size. */
+class FPQCompressor {
+    public:
+        FPQCompressor(FPQThreadPool &threads, FPQStats *stats = NULL, size_t chunkSize = FPQ_LZ_CHUNK_SIZE);
+
+        /* Compresses all of 'input' to the start of 'output', returns the stream
+         * size. 'consume', when set, sees the raw input in order as it is read */
+        uint64_t compress(FPQFile &input, FPQFile &output, int section,
+                          const std::function<void(const uint8_t*, size_t)> &consume = nullptr);
+
+        /* Expands a stream that starts at 'offset' of 'input' and spans at most
+         * 'size' bytes (padding after it is ignored), returns the raw size */
+        uint64_t decompress(FPQFile &input, uint64_t offset, uint64_t size, FPQFile &output, int section);
+
+        static const uint32_t magic = 0x5a515046;   // "FPQZ"
+        static const uint32_t storedFlag = 0x80000000;
+        static const uint32_t maxChunkSize = 64 * 1024 * 1024;
+
+    private:
+        FPQThreadPool &threads;
+        FPQStats *stats;
+        size_t chunkSize;
+};
+
+#endif /* __FPQ_COMPRESS_H__ */
@@ -0,0 +1,353 @@
+/*
+* 	File: fpq_daemon.cpp
+* 	Brief: Long-lived pack service on a Unix socket implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <sstream>
+#include <queue>
+#include <thread>
+#include <condition_variable>
+#include "fpqpack.h"
+#include "fpq_daemon.h"
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+#define DAEMON_MAX_REQUEST    (64 * 1024)
+
+
+std::shared_ptr<const FPQWarmCache::Section> FPQWarmCache::get(const std::string &path, FPQEncryptor &encryptor, bool &hit) {
+    std::string key;
+    #ifdef _WIN32
+        throw std::runtime_error("Daemon mode is not supported on Windows!");
+    #else
+        struct stat st;
+        if (stat(path.c_str(), &st) || !S_ISREG(st.st_mode)) throw std::runtime_error(std::string("Unable open '" + path + "'!").c_str());
+        if ((uint64_t)st.st_size > UINT32_MAX - FPQHeader::blkSize()) throw std::runtime_error(std::string("'" + path + "' is too large!").c_str());
+        #ifdef __APPLE__
+            uint64_t mtime = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ULL + st.st_mtimespec.tv_nsec;
+        #else
+            uint64_t mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+        #endif
+        key = path + "\n" + std::to_string(st.st_size) + "\n" + std::to_string(mtime) + "\n" + encryptor.getKey();
+    #endif
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = entries.find(key);
+        if (entry != entries.end()) {
+            entry->second.lastUse = ++clock;
+            hits++;
+            hit = true;
+            return entry->second.section;
+        }
+    }
+
+    // Loaded without the lock: two requests may load the same file, the first insert wins
+    std::shared_ptr<Section> section(new Section);
+    FPQFile input(path, FPQFile::OpenMode::ROpen);
+    section->size = input.size();
+    section->data.resize(FPQHeader::align(section->size));
+    input.readAt(section->data.data(), section->size, 0);
+    uint32_t inCrc = CRC32_Init(), outCrc = CRC32_Init();
+    encryptor.encrypt(section->data.data(), section->data.data(), section->data.size(), inCrc, outCrc);
+    section->plainCrc = CRC32_Final(inCrc);
+    section->cipherCrc = CRC32_Final(outCrc);
+
+    std::lock_guard<std::mutex> guard(lock);
+    misses++;
+    hit = false;
+    auto inserted = entries.insert({ key, Entry { section, ++clock } });
+    if (inserted.second) {
+        bytes += section->data.size();
+        evict();
+    }
+    return inserted.first->second.section;
+}
+
+void FPQWarmCache::evict(void) {
+    while (bytes > maxBytes && entries.size() > 1) {
+        auto oldest = entries.begin();
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+            if (entry->second.lastUse < oldest->second.lastUse) oldest = entry;
+        bytes -= oldest->second.section->data.size();
+        entries.erase(oldest);
+    }
+}
+
+std::string FPQWarmCache::toJson(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::ostringstream json;
+    json << "{\"result\":\"ok\",\"entries\":" << entries.size() << ",\"bytes\":" << bytes << ",\"max_bytes\":" << maxBytes
+         << ",\"hits\":" << hits << ",\"misses\":" << misses << "}";
+    return json.str();
+}
+
+static std::string errorJson(const std::string &error) {
+    return "{\"result\":\"error\",\"error\":\"" + jsonEscape(error) + "\"}";
+}
+
+#ifdef _WIN32
+
+FPQDaemon::FPQDaemon(FPQContext &ctx, const std::string &socketPath, uint64_t cacheBytes)
+    : ctx(ctx), socketPath(socketPath), cache(cacheBytes), listener(-1), stopping(false) {
+    throw std::runtime_error("Daemon mode is not supported on Windows!");
+}
+
+FPQDaemon::~FPQDaemon() { }
+
+void FPQDaemon::run(void) { }
+
+std::string FPQDaemon::request(const std::string &, const std::string &) {
+    throw std::runtime_error("Daemon mode is not supported on Windows!");
+}
+
+void FPQDaemon::serve(int) { }
+
+std::string FPQDaemon::handle(const std::string &) { return ""; }
+
+unsigned FPQDaemon::load(const Fields &, FPQEncryptor &, Sections &) { return 0; }
+
+uint32_t FPQDaemon::write(const Sections &, FPQEncryptor &, uint32_t, bool, const std::string &) { return 0; }
+
+#else
+
+static sockaddr_un socketAddress(const std::string &path) {
+    sockaddr_un addr = {};
+    if (path.length() >= sizeof(addr.sun_path)) throw std::runtime_error(std::string("Socket path '" + path + "' is too long!").c_str());
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    return addr;
+}
+
+static void sendAll(int fd, const std::string &data) {
+    for (size_t done = 0; done < data.size(); ) {
+        ssize_t sent = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return;      // the client went away, nothing left to tell it
+        done += sent;
+    }
+}
+
+FPQDaemon::FPQDaemon(FPQContext &ctx, const std::string &socketPath, uint64_t cacheBytes)
+    : ctx(ctx), socketPath(socketPath), cache(cacheBytes), listener(-1), stopping(false) {
+    sockaddr_un addr = socketAddress(socketPath);
+
+    // a socket left over by a daemon that did not shut down cleanly is replaced, anything else is not
+    struct stat st;
+    if (!lstat(socketPath.c_str(), &st)) {
+        if (!S_ISSOCK(st.st_mode)) throw std::runtime_error(std::string("'" + socketPath + "' exists and is not a socket!").c_str());
+        unlink(socketPath.c_str());
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throw std::runtime_error("Unable to create socket!");
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, SOMAXCONN)) {
+        close(listener);
+        throw std::runtime_error(std::string("Unable to listen on '" + socketPath + "'!").c_str());
+    }
+}
+
+FPQDaemon::~FPQDaemon() {
+    close(listener);
+    unlink(socketPath.c_str());
+}
+
+void FPQDaemon::run(void) {
+    std::queue<int> clients;
+    std::mutex queueLock;
+    std::condition_variable queued;
+    bool done = false;
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::max(1U, ctx.jobs); ++i) {
+        workers.emplace_back([&]() {
+            for (;;) {
+                int client;
+                {
+                    std::unique_lock<std::mutex> guard(queueLock);
+                    queued.wait(guard, [&]() { return done || !clients.empty(); });
+                    if (clients.empty()) return;
+                    client = clients.front();
+                    clients.pop();
+                }
+                serve(client);
+            }
+        });
+    }
+
+    while (!stopping) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            clients.push(client);
+        }
+        queued.notify_one();
+    }
+
+    // connections already accepted are still answered
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        done = true;
+    }
+    queued.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+void FPQDaemon::serve(int client) {
+    std::string line;
+    char chunk[4096];
+    while (line.find('\n') == std::string::npos && line.size() < DAEMON_MAX_REQUEST) {
+        ssize_t got = recv(client, chunk, sizeof(chunk), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        line.append(chunk, got);
+    }
+    line = line.substr(0, line.find('\n'));
+
+    sendAll(client, handle(line));
+    close(client);
+}
+
+std::string FPQDaemon::request(const std::string &socketPath, const std::string &line) {
+    sockaddr_un addr = socketAddress(socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error(std::string("Unable to connect to '" + socketPath + "'!").c_str());
+    }
+
+    sendAll(fd, line + "\n");
+    shutdown(fd, SHUT_WR);
+    std::string response;
+    char chunk[4096];
+    for (;;) {
+        ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        response.append(chunk, got);
+    }
+    close(fd);
+    return response;
+}
+
+std::string FPQDaemon::handle(const std::string &line) {
+    uint64_t start = FPQStats::wallNs();
+    std::istringstream items(line);
+    std::string command, item;
+    Fields fields;
+    std::getline(items, command, '\t');
+    while (std::getline(items, item, '\t')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return errorJson("Malformed field '" + item + "'");
+        fields.insert({ item.substr(0, eq), item.substr(eq + 1) });
+    }
+    auto field = [&fields](const std::string &name) {
+        auto it = fields.find(name);
+        return it == fields.end() ? std::string() : it->second;
+    };
+    auto elapsed = [start]() { return std::to_string((FPQStats::wallNs() - start) / 1000000.0); };
+
+    std::string response;
+    try {
+        FPQEncryptor encryptor = field("k").empty() ? FPQEncryptor() : FPQEncryptor(field("k"));
+
+        if (command == "pack" || command == "batch") {
+            if (field("o").empty()) throw std::runtime_error("Output is not specified!");
+            Sections sections;
+            unsigned hits = load(fields, encryptor, sections);
+            bool checksums = !field("a").empty();
+
+            std::vector<std::pair<FPQSerial,std::string>> images;
+            if (command == "pack") images.push_back({ field("h").empty() ? FPQSerial() : FPQSerial(field("h")), field("o") });
+            else {
+                makeDir(field("o"));
+                for (auto &serial : parseSerials(field("n")))
+                    images.push_back({ serial, field("o") + "/firmware_" + serial.getStr() + ".bin" });
+            }
+            for (auto &image : images) {
+                uint32_t size = write(sections, encryptor, image.first.get(), checksums, image.second);
+                response += "{\"result\":\"ok\",\"image\":\"" + jsonEscape(image.second) + "\",\"size\":" + std::to_string(size) +
+                            ",\"hits\":" + std::to_string(hits) + ",\"misses\":" + std::to_string(sections.size() - hits) +
+                            ",\"ms\":" + elapsed() + "}\n";
+            }
+        }
+        else if (command == "verify") {
+            for (auto range = fields.equal_range("v"); range.first != range.second; ++range.first)
+                response += verifyImage(encryptor, range.first->second).toJson() + "\n";
+        }
+        else if (command == "stats") response = cache.toJson() + "\n";
+        else if (command == "quit") {
+            stopping = true;
+            shutdown(listener, SHUT_RDWR);      // wakes up accept()
+            response = "{\"result\":\"ok\"}\n";
+        }
+        else throw std::runtime_error("Unknown command '" + command + "'");
+    }
+    catch (const std::exception &e) {
+        response = errorJson(e.what()) + "\n";
+    }
+
+    if (ctx.debug) {
+        std::lock_guard<std::mutex> guard(logLock);
+        ctx.log(command, " served in ", elapsed(), " ms\n");
+    }
+    return response;
+}
+
+unsigned FPQDaemon::load(const Fields &fields, FPQEncryptor &encryptor, Sections &sections) {
+    const std::map<std::string,int> names = { { "c", FPQHeader::Type::Config }, { "b", FPQHeader::Type::UBoot },
+        { "x", FPQHeader::Type::Linux }, { "s", FPQHeader::Type::LiteOS }, { "f", FPQHeader::Type::RootFS } };
+    unsigned hits = 0;
+
+    for (auto &name : names) {
+        auto it = fields.find(name.first);
+        if (it == fields.end()) continue;
+        bool hit;
+        sections[name.second] = cache.get(it->second, encryptor, hit);
+        hits += hit;
+    }
+    if (!sections.count(FPQHeader::Type::Config)) throw std::runtime_error("Config file is not specified!");
+    return hits;
+}
+
+uint32_t FPQDaemon::write(const Sections &sections, FPQEncryptor &encryptor, uint32_t serial, bool checksums, const std::string &outputPath) {
+    FPQHeader header;
+    for (auto &section : sections) header.setSize((FPQHeader::Type)section.first, section.second->size);
+    header.setSize(FPQHeader::Type::Serial, FPQHeader::blkSize());
+    header.updateOffsets();
+
+    std::vector<uint8_t> serialBlk = FPQHeader::makeSerial(serial);
+    uint32_t inCrc = CRC32_Init(), outCrc = CRC32_Init();
+    encryptor.encrypt(serialBlk.data(), serialBlk.data(), serialBlk.size(), inCrc, outCrc);
+    if (checksums) {
+        header.setCrc(FPQHeader::Type::Serial, CRC32_Final(inCrc), CRC32_Final(outCrc));
+        for (auto &section : sections)
+            header.setCrc((FPQHeader::Type)section.first, section.second->plainCrc, section.second->cipherCrc);
+    }
+
+    // written straight from the cached buffers: no reads and no encryption left for this request
+    FPQFile output(outputPath, FPQFile::OpenMode::RWCreate);
+    output.resize(header.imageSize());
+    for (auto &section : sections) {
+        output.writeAt(section.second->data.data(), section.second->data.size(), header.field((FPQHeader::Type)section.first).offset);
+    }
+    output.writeAt(serialBlk.data(), serialBlk.size(), header.field(FPQHeader::Type::Serial).offset);
+    std::vector<uint8_t> headerBlk(header.begin(), header.end());
+    encryptor.encrypt(headerBlk);
+    output.writeAt(headerBlk.data(), headerBlk.size(), 0);
+    return header.imageSize();
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+* 	File: fpq_daemon.h
+* 	Brief: Long-lived pack service on a Unix socket
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_DAEMON_H__
+#define __FPQ_DAEMON_H__
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "fpq_image.h"
+
+/* Encrypted sections kept in memory, padded to the block size exactly as
+ * they appear in an image, keyed by path, size, modification time and
+ * key. A changed file gets a new key, so a stale entry is never served,
+ * it just ages out. Least recently used entries go first once the total
+ * passes the cap; requests still holding one keep it alive. */
+class FPQWarmCache {
+    public:
+        struct Section {
+            std::vector<uint8_t> data;
+            uint32_t size;              // unpadded input size
+            uint32_t plainCrc, cipherCrc;
+        };
+
+        explicit FPQWarmCache(uint64_t maxBytes) : maxBytes(maxBytes), bytes(0), clock(0), hits(0), misses(0) { }
+
+        // Encrypted section for the file at 'path', read and encrypted on a miss
+        std::shared_ptr<const Section> get(const std::string &path, FPQEncryptor &encryptor, bool &hit);
+
+        std::string toJson(void);
+
+    private:
+        struct Entry { std::shared_ptr<const Section> section; uint64_t lastUse; };
+
+        void evict(void);
+
+        std::map<std::string,Entry> entries;
+        uint64_t maxBytes, bytes, clock;
+        std::atomic<uint64_t> hits, misses;
+        std::mutex lock;
+};
+
+/* Serves requests on a Unix stream socket, one request per connection:
+ * a line of tab separated fields, the command first and then name=value
+ * pairs named after the fpq_pack options,
+ *
+ *     pack    o= c= b= x= s= f= k= h= a=    one image, same bytes as fpq_pack
+ *     batch   o= n= (and the pack fields)   one image per serial into directory o
+ *     verify  v= (repeated) k=              verify images
+ *     stats                                 warm cache counters
+ *     quit                                  stop the daemon
+ *
+ * and answered with one JSON line per image (or one for stats and
+ * errors). Paths are used as given, relative ones resolve against the
+ * daemon's working directory. ctx.jobs connections are served at once. */
+class FPQDaemon {
+    public:
+        FPQDaemon(FPQContext &ctx, const std::string &socketPath, uint64_t cacheBytes);
+        ~FPQDaemon();
+        FPQDaemon(const FPQDaemon &) = delete;
+        FPQDaemon &operator=(const FPQDaemon &) = delete;
+
+        // Accepts connections until a 'quit' request
+        void run(void);
+
+        // Sends one request line, returns the response lines
+        static std::string request(const std::string &socketPath, const std::string &line);
+
+    private:
+        typedef std::multimap<std::string,std::string> Fields;
+        typedef std::map<int,std::shared_ptr<const FPQWarmCache::Section>> Sections;
+
+        void serve(int client);
+        std::string handle(const std::string &line);
+        unsigned load(const Fields &fields, FPQEncryptor &encryptor, Sections &sections);
+        uint32_t write(const Sections &sections, FPQEncryptor &encryptor, uint32_t serial, bool checksums, const std::string &outputPath);
+
+        FPQContext &ctx;
+        std::string socketPath;
+        FPQWarmCache cache;
+        int listener;
+        std::atomic<bool> stopping;
+        std::mutex logLock;
+};
+
+#endif /* __FPQ_DAEMON_H__ */
@@ -0,0 +1,335 @@
+/*
+* 	File: fpq_delta.cpp
+* 	Brief: Binary patches between two packed images implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <cstring>
+#include "fpqpack.h"
+#include "fpq_delta.h"
+#include "lz.h"
+#include "sha256.h"
+
+static const char deltaMagic[8] = { 'F', 'P', 'Q', 'D', 'E', 'L', 'T', 'A' };
+static const uint32_t deltaVersion = 2;
+static const size_t literalLimit = 1024 * 1024;    // largest literal operation, whatever buffer size made the patch
+static const size_t indexLimit = FPQ_DELTA_INDEX_ENTRIES;
+static const size_t windowBlocks = 128;             // base blocks read at once to confirm matches
+
+struct FPQDeltaHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockSize;
+    uint64_t baseSize;
+    uint64_t resultSize;
+    uint32_t baseHeaderCrc;
+    uint32_t reserved;
+    uint8_t resultSha256[SHA256_DIGEST_SIZE];
+};
+
+enum FPQDeltaOp : uint8_t { Copy = 'C', Data = 'D', Packed = 'Z', End = 'E' };
+
+static uint64_t blockHash(const uint8_t *data) { return FPQCache::hash64(data, FPQHeader::blkSize(), 0); }
+
+static uint32_t headerBlockCrc(FPQFile &image) {
+    std::vector<uint8_t> block(FPQHeader::blkSize());
+    image.readAt(block.data(), block.size(), 0);
+    return CRC32_Calculate(block.data(), block.size());
+}
+
+// Sequential patch writer: merges adjacent copies and gathers literals up to 'limit' bytes
+class FPQDeltaWriter {
+    public:
+        FPQDeltaWriter(FPQFile &patch, size_t limit) : patch(patch), limit(limit), runStart(0), runLength(0),
+            packed(LZ_Bound(limit)), copied(0), literal(0), written(0) { pending.reserve(limit); }
+
+        void copy(uint32_t block) {
+            flushData();
+            if (runLength && runStart + runLength == block) { runLength++; return; }
+            flushCopy();
+            runStart = block;
+            runLength = 1;
+        }
+
+        void data(const uint8_t *bytes, size_t size) {
+            flushCopy();
+            for (size_t done = 0; done < size; ) {
+                size_t chunk = std::min(size - done, limit - pending.size());
+                pending.insert(pending.end(), bytes + done, bytes + done + chunk);
+                done += chunk;
+                if (pending.size() == limit) flushData();
+            }
+        }
+
+        void finish(void) {
+            flushCopy();
+            flushData();
+            put(End);
+        }
+
+        // the next copy continues the current run from this base block
+        bool continues(uint32_t &block) const { block = runStart + runLength; return runLength != 0; }
+
+        uint64_t copiedBytes(void) const { return copied; }
+        uint64_t literalBytes(void) const { return literal; }
+        uint64_t patchBytes(void) const { return written; }
+
+    private:
+        void put(uint8_t op) { patch.write(&op, sizeof(op)); written += sizeof(op); }
+        void put(uint32_t word) { patch.write((const uint8_t*)&word, sizeof(word)); written += sizeof(word); }
+
+        void flushCopy(void) {
+            if (!runLength) return;
+            put(Copy);
+            put(runStart);
+            put(runLength);
+            copied += (uint64_t)runLength * FPQHeader::blkSize();
+            runLength = 0;
+        }
+
+        void flushData(void) {
+            if (pending.empty()) return;
+            size_t size = LZ_Compress(packed.data(), pending.size() - 1, pending.data(), pending.size());
+            put(size ? Packed : Data);
+            put((uint32_t)pending.size());
+            if (size) put((uint32_t)size);
+            const uint8_t *bytes = size ? packed.data() : pending.data();
+            size = size ? size : pending.size();
+            patch.write(bytes, size);
+            written += size;
+            literal += pending.size();
+            pending.clear();
+        }
+
+        FPQFile &patch;
+        size_t limit;
+        uint32_t runStart, runLength;
+        std::vector<uint8_t> pending, packed;
+        uint64_t copied, literal, written;
+};
+
+// Writes the patch turning 'baseImage' into 'newImage' to 'patchPath', returns its size
+static uint64_t writeDelta(FPQContext &ctx, const std::string &baseImage, const std::string &newImage, const std::string &patchPath) {
+    FPQFile base(baseImage, FPQFile::OpenMode::ROpen), image(newImage, FPQFile::OpenMode::ROpen);
+    FPQHeader::load(base, ctx.encryptor);
+    FPQHeader header = FPQHeader::load(image, ctx.encryptor);
+    if (ctx.debug) header.dumpLog(ctx.log);
+
+    const uint32_t blkSize = FPQHeader::blkSize();
+    FPQThreadPool threads(ctx.jobs);
+    FPQBufferPool pool(ctx.bufferSize, threads.size());
+    const size_t blocksPerChunk = ctx.bufferSize / blkSize;
+
+    /* Index of the base, sorted for lookups and built in parallel. Past indexLimit blocks only
+     * those whose hash is a multiple of 'stride' go in: the choice depends on the content alone,
+     * so moved data is found at the same blocks, and the copy runs extend from there */
+    const uint32_t baseBlocks = base.size() / blkSize;
+    const uint64_t stride = std::max<uint64_t>(1, (baseBlocks + indexLimit - 1) / indexLimit);
+    size_t chunks = (baseBlocks + blocksPerChunk - 1) / blocksPerChunk;
+    std::vector<std::vector<std::pair<uint64_t,uint32_t>>> parts(chunks);
+    threads.run(chunks, [&](size_t i) {
+        FPQBufferPool::Lease buffer(pool);
+        size_t first = i * blocksPerChunk, count = std::min<size_t>(baseBlocks - first, blocksPerChunk);
+        base.readAt(buffer->data(), count * blkSize, (uint64_t)first * blkSize);
+        for (size_t b = 0; b < count; ++b) {
+            uint64_t hash = blockHash(buffer->data() + b * blkSize);
+            if (hash % stride == 0) parts[i].push_back({ hash, (uint32_t)(first + b) });
+        }
+    });
+    std::vector<std::pair<uint64_t,uint32_t>> index;
+    for (auto &part : parts) {
+        index.insert(index.end(), part.begin(), part.end());
+        std::vector<std::pair<uint64_t,uint32_t>>().swap(part);
+    }
+    std::sort(index.begin(), index.end());
+    if (index.size() > indexLimit) index.resize(indexLimit);
+    if (ctx.debug) ctx.log(std::dec, "Indexed ", index.size(), " of ", baseBlocks, " base blocks\n");
+
+    // Hashes only propose matches, a copy is emitted after the base block compared equal
+    FPQBuffer window(windowBlocks * blkSize);
+    uint32_t windowFirst = 0, windowCount = 0;
+    auto sameAsBase = [&](uint32_t block, const uint8_t *data) {
+        if (block >= baseBlocks) return false;
+        if (block < windowFirst || block >= windowFirst + windowCount) {
+            windowFirst = block;
+            windowCount = std::min<uint32_t>(windowBlocks, baseBlocks - block);
+            base.readAt(window.data(), (size_t)windowCount * blkSize, (uint64_t)block * blkSize);
+        }
+        return !memcmp(window.data() + (size_t)(block - windowFirst) * blkSize, data, blkSize);
+    };
+
+    FPQFile patch(patchPath, FPQFile::OpenMode::RWCreate);
+    FPQDeltaHeader delta;
+    std::copy(deltaMagic, deltaMagic + sizeof(deltaMagic), delta.magic);
+    delta.version = deltaVersion;
+    delta.blockSize = blkSize;
+    delta.baseSize = base.size();
+    delta.resultSize = image.size();
+    delta.baseHeaderCrc = headerBlockCrc(base);
+    delta.reserved = 0;
+    patch.write((const uint8_t*)&delta, sizeof(delta));
+
+    // The new image goes through in batches: read and hash in parallel, then emit in order
+    FPQDeltaWriter writer(patch, literalLimit);
+    std::vector<uint64_t> changed(FPQHeader::Type::FileNum_ + 1);
+    std::vector<std::vector<uint64_t>> hashes(threads.size());
+    SHA256_Context sha;
+    SHA256_Init(&sha);
+    for (uint64_t batchPos = 0; batchPos < image.size(); batchPos += (uint64_t)threads.size() * ctx.bufferSize) {
+        std::vector<std::unique_ptr<FPQBufferPool::Lease>> buffers;
+        std::vector<size_t> sizes(threads.size());
+        for (unsigned t = 0; t < threads.size(); ++t) buffers.emplace_back(new FPQBufferPool::Lease(pool));
+
+        size_t batch = std::min<uint64_t>((image.size() - batchPos + ctx.bufferSize - 1) / ctx.bufferSize, threads.size());
+        threads.run(batch, [&](size_t i) {
+            uint64_t pos = batchPos + i * ctx.bufferSize;
+            FPQBuffer &buffer = **buffers[i];
+            sizes[i] = std::min<uint64_t>(image.size() - pos, ctx.bufferSize);
+            image.readAt(buffer.data(), sizes[i], pos);
+            hashes[i].resize(sizes[i] / blkSize);
+            for (size_t b = 0; b < hashes[i].size(); ++b) hashes[i][b] = blockHash(buffer.data() + b * blkSize);
+        });
+
+        for (size_t i = 0; i < batch; ++i) {
+            const uint8_t *data = (**buffers[i]).data();
+            SHA256_Update(&sha, data, sizes[i]);
+            for (size_t b = 0; b < hashes[i].size(); ++b) {
+                const uint8_t *block = data + b * blkSize;
+                uint32_t next;
+                if (writer.continues(next) && sameAsBase(next, block)) {
+                    writer.copy(next);
+                    continue;
+                }
+                auto match = std::lower_bound(index.begin(), index.end(), std::make_pair(hashes[i][b], (uint32_t)0));
+                while (match != index.end() && match->first == hashes[i][b] && !sameAsBase(match->second, block)) ++match;
+                if (match != index.end() && match->first == hashes[i][b]) writer.copy(match->second);
+                else {
+                    writer.data(block, blkSize);
+                    uint64_t offset = batchPos + i * ctx.bufferSize + b * blkSize;
+                    int section = FPQHeader::Type::FileNum_;
+                    for (int s = 0; s < FPQHeader::Type::FileNum_; ++s) {
+                        FPQHeader::_field &field = header.field((FPQHeader::Type)s);
+                        if (offset >= field.offset && offset < (uint64_t)field.offset + field.size) section = s;
+                    }
+                    changed[section] += blkSize;
+                }
+            }
+            // a tail shorter than a block can only be literal
+            size_t tail = hashes[i].size() * blkSize;
+            if (tail < sizes[i]) writer.data(data + tail, sizes[i] - tail);
+        }
+    }
+    writer.finish();
+
+    SHA256_Final(&sha, delta.resultSha256);
+    patch.writeAt((const uint8_t*)&delta, sizeof(delta), 0);
+
+    if (ctx.debug) {
+        for (int s = 0; s <= FPQHeader::Type::FileNum_; ++s) {
+            if (!changed[s]) continue;
+            std::string name = (s == FPQHeader::Type::FileNum_) ? std::string("Header") : FPQHeader::getName(s);
+            ctx.log(std::dec, name, ": ", changed[s], " bytes changed\n");
+        }
+        ctx.log(std::dec, "Copied ", writer.copiedBytes(), " bytes, literal ", writer.literalBytes(),
+                " bytes, patch ", sizeof(delta) + writer.patchBytes(), " bytes\n");
+    }
+    return sizeof(delta) + writer.patchBytes();
+}
+
+uint64_t deltaImage(FPQContext &ctx, const std::string &baseImage, const std::string &newImage, const std::string &patchPath) {
+    if (sameFile(patchPath, baseImage) || sameFile(patchPath, newImage))
+        throw std::runtime_error(std::string("The patch would overwrite '" + patchPath + "'!").c_str());
+
+    // the patch appears under its name only when complete; the app does not catch, so nothing would unwind to clean up
+    std::string tmpPath = tempPath(patchPath);
+    try {
+        uint64_t size = writeDelta(ctx, baseImage, newImage, tmpPath);
+        replaceFile(tmpPath, patchPath);
+        return size;
+    }
+    catch (...) {
+        remove(tmpPath.c_str());
+        throw;
+    }
+}
+
+// Writes the patched image to 'path', returns its size; throws unless it has the size and SHA-256 the patch expects
+static uint64_t writePatched(FPQContext &ctx, FPQFile &patch, const FPQDeltaHeader &delta, FPQFile &base, const std::string &path) {
+    FPQFile output(path, FPQFile::OpenMode::RWCreate);
+    FPQBuffer buffer(std::max(ctx.bufferSize, literalLimit));
+    std::vector<uint8_t> packed(LZ_Bound(literalLimit));
+    SHA256_Context sha;
+    SHA256_Init(&sha);
+    uint64_t size = 0;
+    auto emit = [&](const uint8_t *data, size_t length) {
+        if (size + length > delta.resultSize) throw std::runtime_error("Patch writes past the end of the image!");
+        output.write(data, length);
+        SHA256_Update(&sha, data, length);
+        size += length;
+    };
+
+    for (uint8_t op = 0; op != End; ) {
+        patch.read(&op, sizeof(op));
+        uint32_t words[2];
+        if (op == Copy) {
+            patch.read((uint8_t*)words, sizeof(words));
+            uint64_t from = (uint64_t)words[0] * FPQHeader::blkSize(), length = (uint64_t)words[1] * FPQHeader::blkSize();
+            if (from + length > base.size()) throw std::runtime_error("Patch copies past the end of the base image!");
+            for (uint64_t done = 0; done < length; ) {
+                size_t chunk = std::min<uint64_t>(length - done, buffer.size());
+                base.readAt(buffer.data(), chunk, from + done);
+                emit(buffer.data(), chunk);
+                done += chunk;
+            }
+        }
+        else if (op == Data || op == Packed) {
+            patch.read((uint8_t*)words, op == Packed ? sizeof(words) : sizeof(uint32_t));
+            if (words[0] > literalLimit) throw std::runtime_error("Corrupted patch!");
+            if (op == Data) patch.read(buffer.data(), words[0]);
+            else {
+                if (words[1] > packed.size()) throw std::runtime_error("Corrupted patch!");
+                patch.read(packed.data(), words[1]);
+                if (LZ_Decompress(buffer.data(), words[0], packed.data(), words[1]) != (int64_t)words[0])
+                    throw std::runtime_error("Corrupted patch!");
+            }
+            emit(buffer.data(), words[0]);
+        }
+        else if (op != End) throw std::runtime_error("Corrupted patch!");
+    }
+
+    uint8_t resultSha256[SHA256_DIGEST_SIZE];
+    SHA256_Final(&sha, resultSha256);
+    if (size != delta.resultSize || memcmp(resultSha256, delta.resultSha256, sizeof(resultSha256)))
+        throw std::runtime_error("Patched image does not match, wrong base image?");
+    return size;
+}
+
+void applyDelta(FPQContext &ctx, const std::string &baseImage, const std::string &patchPath, const std::string &outputPath) {
+    FPQFile patch(patchPath, FPQFile::OpenMode::ROpen);
+    FPQDeltaHeader delta;
+    patch.read((uint8_t*)&delta, sizeof(delta));
+    if (!std::equal(deltaMagic, deltaMagic + sizeof(deltaMagic), delta.magic) || delta.version != deltaVersion)
+        throw std::runtime_error(std::string("'" + patchPath + "' is not a firmware patch!").c_str());
+    if (delta.blockSize != FPQHeader::blkSize()) throw std::runtime_error("Unsupported patch block size!");
+
+    if (sameFile(outputPath, baseImage))
+        throw std::runtime_error(std::string("The result would overwrite the base image '" + baseImage + "'!").c_str());
+    FPQFile base(baseImage, FPQFile::OpenMode::ROpen);
+    if (base.size() != delta.baseSize || base.size() < FPQHeader::blkSize() || headerBlockCrc(base) != delta.baseHeaderCrc)
+        throw std::runtime_error(std::string("'" + baseImage + "' is not the image this patch was made for!").c_str());
+
+    // written beside the output and moved over it once the digest matches, a failed patch leaves nothing behind
+    std::string tmpPath = tempPath(outputPath);
+    uint64_t size;
+    try {
+        size = writePatched(ctx, patch, delta, base, tmpPath);
+        replaceFile(tmpPath, outputPath);
+    }
+    catch (...) {
+        remove(tmpPath.c_str());
+        throw;
+    }
+    if (ctx.debug) ctx.log(std::dec, "Patched ", size, " bytes into '", outputPath, "'\n");
+}
+
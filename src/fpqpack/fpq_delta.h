@@ -0,0 +1,47 @@
+/*
+* 	File: fpq_delta.h
+* 	Brief: Binary patches between two packed images
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_DELTA_H__
+#define __FPQ_DELTA_H__
+
+#include <string>
+#include "fpq_image.h"
+
+#define FPQ_DELTA_INDEX_ENTRIES   (4 * 1024 * 1024)
+
+/* Works on the encrypted images as they are. The keystream restarts at
+ * every block and sections are block aligned, so a block that did not
+ * change encrypts to the same bytes wherever it moved to: matching
+ * 512-byte blocks by hash, then by their bytes, finds everything there is
+ * to reuse, and the patch carries ciphertext only.
+ *
+ *     "FPQDELTA" | version | block size | base size | result size |
+ *     CRC32 of the base header block | reserved | SHA-256 of the result |
+ *     operations
+ *
+ * Operations, each a tag byte and 32-bit words in host order:
+ *     'C' first block, count    copy blocks of the base image
+ *     'D' size, bytes           literal bytes
+ *     'Z' size, packed, bytes   literal bytes, LZ compressed
+ *     'E'                       end of patch
+ */
+
+/* Writes a patch that turns baseImage into newImage. Base block hashes
+ * are computed in parallel and kept in a sorted index of at most
+ * FPQ_DELTA_INDEX_ENTRIES entries (16 bytes each); larger bases index a
+ * content-defined sample of their blocks and copies are extended block by
+ * block from the sampled ones. The new image is streamed through
+ * jobs * bufferSize bytes at a time. Both headers are decrypted to check the images and, in debug
+ * mode, to report changes per section. Returns the patch size. */
+uint64_t deltaImage(FPQContext &ctx, const std::string &baseImage, const std::string &newImage, const std::string &patchPath);
+
+/* Rebuilds the new image from the base and a patch, reading the patch
+ * once and the base only where blocks are copied. Needs no key: the base
+ * is checked against the patch before, the result after writing it. */
+void applyDelta(FPQContext &ctx, const std::string &baseImage, const std::string &patchPath, const std::string &outputPath);
+
+#endif /* __FPQ_DELTA_H__ */
@@ -0,0 +1,108 @@
+/*
+* 	File: fpq_digest.cpp
+* 	Brief: SHA-256 digests implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <fstream>
+#include <stdexcept>
+#include "fpq_digest.h"
+
+
+FPQDigester::FPQDigester(unsigned threads, FPQStats *stats, size_t queueLimit)
+    : stats(stats), queueLimit(queueLimit), queued(0), stopping(false) {
+    for (unsigned t = 0; t < std::max(1U, threads); ++t) {
+        workers.emplace_back([this]() {
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                Stream *stream = NULL;
+                changed.wait(guard, [this, &stream]() { return (stream = pick()) || (stopping && !queued); });
+                if (!stream) return;
+
+                std::vector<uint8_t> chunk(std::move(stream->queue.front()));
+                stream->queue.pop_front();
+                stream->busy = true;
+                guard.unlock();
+                {
+                    FPQStats::Scope scope(this->stats, stream->section, FPQStats::Digest, chunk.size());
+                    SHA256_Update(&stream->sha, chunk.data(), chunk.size());
+                }
+                guard.lock();
+                stream->busy = false;
+                queued -= chunk.size();
+                changed.notify_all();
+            }
+        });
+    }
+}
+
+FPQDigester::~FPQDigester() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+// Any stream with queued data that no worker holds; called with the lock held
+FPQDigester::Stream *FPQDigester::pick(void) {
+    for (auto &stream : streams) {
+        if (!stream->busy && !stream->queue.empty()) return stream.get();
+    }
+    return NULL;
+}
+
+int FPQDigester::open(const std::string &name, int section) {
+    std::lock_guard<std::mutex> guard(lock);
+    streams.emplace_back(new Stream());
+    Stream &stream = *streams.back();
+    stream.name = name;
+    stream.section = section;
+    stream.busy = false;
+    SHA256_Init(&stream.sha);
+    return streams.size() - 1;
+}
+
+void FPQDigester::update(int stream, const uint8_t *data, size_t size) {
+    if (!size) return;
+    std::vector<uint8_t> chunk(data, data + size);
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this]() { return !queued || queued < queueLimit; });
+    streams.at(stream)->queue.push_back(std::move(chunk));
+    queued += size;
+    changed.notify_all();
+}
+
+void FPQDigester::restart(int stream) {
+    std::unique_lock<std::mutex> guard(lock);
+    Stream &s = *streams.at(stream);
+    changed.wait(guard, [&s]() { return s.queue.empty() && !s.busy; });
+    SHA256_Init(&s.sha);
+}
+
+std::string FPQDigester::hex(int stream) {
+    std::unique_lock<std::mutex> guard(lock);
+    Stream &s = *streams.at(stream);
+    changed.wait(guard, [&s]() { return s.queue.empty() && !s.busy; });
+
+    SHA256_Context sha = s.sha;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    SHA256_Final(&sha, digest);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string text;
+    for (uint8_t byte : digest) {
+        text += digits[byte >> 4];
+        text += digits[byte & 0x0F];
+    }
+    return text;
+}
+
+void FPQDigester::writeManifest(const std::string &path) {
+    std::ofstream manifest(path, std::ios::out | std::ios::trunc);
+    if (!manifest.is_open()) throw std::runtime_error(std::string("Unable to create '" + path + "'!").c_str());
+    for (size_t i = 0; i < streams.size(); ++i) manifest << hex(i) << "  " << streams[i]->name << "\n";
+    if (!manifest.flush()) throw std::runtime_error(std::string("Unable to write to '" + path + "'!").c_str());
+}
@@ -0,0 +1,75 @@
+/*
+* 	File: fpq_digest.h
+* 	Brief: SHA-256 digests of sections and images, computed while packing
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_DIGEST_H__
+#define __FPQ_DIGEST_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "sha256.h"
+#include "fpq_stats.h"
+
+#define FPQ_DIGEST_QUEUE_SIZE     (64 * 1024 * 1024)
+
+/* Hashes several byte streams at once, each on its own worker: a stream
+ * is fed in order through update(), which copies the data into the
+ * stream's queue and returns, and is picked up by whichever worker is
+ * free. One stream is never hashed by two workers at a time, so the
+ * digest is the plain SHA-256 of the bytes fed. Queued copies are capped
+ * at queueLimit bytes, update() waits for the workers beyond that.
+ *
+ * The manifest has sha256sum's format ("<hex>  <name>"), so that
+ * 'sha256sum -c' checks it. */
+class FPQDigester {
+    public:
+        explicit FPQDigester(unsigned threads, FPQStats *stats = NULL, size_t queueLimit = FPQ_DIGEST_QUEUE_SIZE);
+        ~FPQDigester();
+        FPQDigester(const FPQDigester &) = delete;
+        FPQDigester &operator=(const FPQDigester &) = delete;
+
+        // New stream named 'name' in the manifest, 'section' is its FPQStats row
+        int open(const std::string &name, int section);
+        void update(int stream, const uint8_t *data, size_t size);
+
+        // Drops what the stream was fed so far, once the workers are done with it
+        void restart(int stream);
+
+        // Waits until everything fed to the stream is hashed
+        std::string hex(int stream);
+
+        // One line per stream, in the order they were opened
+        void writeManifest(const std::string &path);
+
+        static const char *kernelName(void) { return SHA256_KernelName(); }
+
+    private:
+        struct Stream {
+            std::string name;
+            int section;
+            SHA256_Context sha;
+            std::deque<std::vector<uint8_t>> queue;
+            bool busy;
+        };
+
+        Stream *pick(void);
+
+        FPQStats *stats;
+        size_t queueLimit, queued;
+        std::vector<std::unique_ptr<Stream>> streams;
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable changed;
+        bool stopping;
+};
+
+#endif /* __FPQ_DIGEST_H__ */
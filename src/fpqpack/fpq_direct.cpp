@@ -0,0 +1,243 @@
+/*
+* 	File: fpq_direct.cpp
+* 	Brief: O_DIRECT image writer implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <cstring>
+#include <memory>
+#include <functional>
+#include "fpq_direct.h"
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+    #ifdef __linux__
+        #include <sys/ioctl.h>
+        #include <linux/fs.h>
+    #endif
+#endif
+
+static const size_t unit = FPQBuffer::alignment;
+
+#ifdef _WIN32
+
+FPQDirectWriter::FPQDirectWriter(const std::string &path, uint64_t imageSize, size_t bufferSize, unsigned depth, FPQOutput mode, FPQStats *stats)
+    : fd(-1), path(path), imageSize(imageSize), position(0), direct(false), blockDevice(false), verify(mode == FPQOutput::DirectVerify),
+      sync(mode != FPQOutput::Buffered), stats(stats),
+      pool(bufferSize, 1), checkPool(bufferSize, 0), current(NULL), used(0), head(unit), headSize(0), busy(0), stopping(false) {
+    (void)depth;
+    throw std::runtime_error("Direct output is not supported on Windows!");
+}
+
+FPQDirectWriter::~FPQDirectWriter() { }
+uint8_t *FPQDirectWriter::claim(size_t &size) { size = 0; return NULL; }
+void FPQDirectWriter::commit(size_t) { }
+void FPQDirectWriter::append(const uint8_t *, size_t) { }
+void FPQDirectWriter::finish(const uint8_t *, size_t) { }
+
+#else
+
+FPQDirectWriter::FPQDirectWriter(const std::string &path, uint64_t imageSize, size_t bufferSize, unsigned depth, FPQOutput mode, FPQStats *stats)
+    : fd(-1), path(path), imageSize(imageSize), position(0), direct(false), blockDevice(false), verify(mode == FPQOutput::DirectVerify),
+      sync(mode != FPQOutput::Buffered), stats(stats),
+      pool(bufferSize, depth + 1), checkPool(bufferSize, verify ? depth + 1 : 0), current(NULL), used(0), head(unit), headSize(0),
+      busy(0), stopping(false) {
+    if (bufferSize % unit) throw std::runtime_error("Buffer size must be a multiple of 4 KiB for direct output!");
+
+    #ifdef O_DIRECT
+        if (sync) fd = open(path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+        direct = (fd >= 0);
+    #endif
+    // some filesystems (tmpfs among them) refuse O_DIRECT, those get the buffered writer and fdatasync()
+    if (fd < 0) fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) throw std::runtime_error(std::string("Unable open '" + path + "'!").c_str());
+    #if !defined(O_DIRECT) && defined(F_NOCACHE)
+        direct = sync && !fcntl(fd, F_NOCACHE, 1);
+    #endif
+
+    struct stat st;
+    bool ok = !fstat(fd, &st);
+    blockDevice = ok && S_ISBLK(st.st_mode);
+    if (blockDevice) {
+        #ifdef BLKGETSIZE64
+            uint64_t deviceSize = 0;
+            if (!ioctl(fd, BLKGETSIZE64, &deviceSize) && deviceSize < imageSize) ok = false;
+        #endif
+    }
+    else ok = ok && !ftruncate(fd, imageSize);
+    if (!ok) {
+        close(fd);
+        throw std::runtime_error(std::string("'" + path + "' cannot hold the image!").c_str());
+    }
+
+    current = pool.acquire();
+    for (unsigned i = 0; i < depth; ++i) {
+        writers.emplace_back([this]() {
+            for (;;) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [this]() { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) return;
+                    job = jobs.front();
+                    jobs.erase(jobs.begin());
+                    busy++;
+                }
+                try {
+                    FPQBuffer *check = this->verify ? checkPool.acquire() : NULL;
+                    std::unique_ptr<FPQBuffer, std::function<void(FPQBuffer*)>> checkLease(check, [this](FPQBuffer *buffer) {
+                        if (buffer) checkPool.release(buffer);
+                    });
+                    writeUnit(job.buffer->data(), job.size, job.offset, check);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!error) error = std::current_exception();
+                }
+                pool.release(job.buffer);
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    busy--;
+                }
+                changed.notify_all();
+            }
+        });
+    }
+}
+
+FPQDirectWriter::~FPQDirectWriter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto &writer : writers) writer.join();
+    if (current) pool.release(current);
+    if (fd >= 0) close(fd);
+}
+
+void FPQDirectWriter::setDirect(bool on) {
+    #ifdef O_DIRECT
+        if (!direct) return;
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, on ? (flags | O_DIRECT) : (flags & ~O_DIRECT));
+    #else
+        (void)on;
+    #endif
+}
+
+void FPQDirectWriter::writeUnit(const uint8_t *data, size_t size, uint64_t offset, FPQBuffer *check) {
+    {
+        FPQStats::Scope scope(stats, FPQStats::image, FPQStats::Write, size);
+        for (size_t done = 0; done < size; ) {
+            ssize_t rc = pwrite(fd, data + done, size - done, offset + done);
+            if (rc < 0 && errno == EINTR) continue;
+            if (rc <= 0) throw std::runtime_error(std::string("Unable to write to '" + path + "'!").c_str());
+            done += rc;
+        }
+    }
+    if (!check) return;
+
+    FPQStats::Scope scope(stats, FPQStats::image, FPQStats::Read, size);
+    for (size_t done = 0; done < size; ) {
+        ssize_t rc = pread(fd, check->data() + done, size - done, offset + done);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) throw std::runtime_error(std::string("Unable to read back '" + path + "'!").c_str());
+        done += rc;
+    }
+    if (memcmp(check->data(), data, size))
+        throw std::runtime_error(std::string("Read-back of '" + path + "' at offset " + std::to_string(offset) + " does not match!").c_str());
+}
+
+void FPQDirectWriter::checkError(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (error) std::rethrow_exception(error);
+}
+
+void FPQDirectWriter::submit(void) {
+    if (!position) {
+        headSize = std::min(used, unit);
+        std::copy(current->data(), current->data() + headSize, head.data());
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back({ current, used, position });
+    }
+    changed.notify_one();
+    position += used;
+    used = 0;
+    current = NULL;
+    current = pool.acquire();       // blocks while 'depth' writes are in flight
+    checkError();
+}
+
+uint8_t *FPQDirectWriter::claim(size_t &size) {
+    if (used == current->size()) submit();
+    size = current->size() - used;
+    return current->data() + used;
+}
+
+void FPQDirectWriter::commit(size_t size) {
+    used += size;
+    if (position + used > imageSize) throw std::runtime_error("Direct output got more data than the image holds!");
+}
+
+void FPQDirectWriter::append(const uint8_t *data, size_t size) {
+    while (size) {
+        size_t room;
+        uint8_t *dst = claim(room);
+        size_t chunk = std::min(room, size);
+        std::copy(data, data + chunk, dst);
+        commit(chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void FPQDirectWriter::finish(const uint8_t *header, size_t headerSize) {
+    if (position + used != imageSize) throw std::runtime_error("Direct output got less data than the image holds!");
+
+    // whole units go through the writers, the rest is kept for the buffered tail write
+    size_t tailSize = direct ? used % unit : 0;
+    uint64_t tailOffset = position + used - tailSize;
+    FPQBuffer tail(unit);
+    std::copy(current->data() + used - tailSize, current->data() + used, tail.data());
+    used -= tailSize;
+    if (used) submit();
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this]() { return jobs.empty() && !busy; });
+        if (error) std::rethrow_exception(error);
+    }
+
+    // the header goes over the first unit, or over the tail when the image is smaller than one
+    uint8_t *first = headSize ? head.data() : tail.data();
+    std::copy(header, header + headerSize, first);
+    std::unique_ptr<FPQBuffer> check(verify ? new FPQBuffer(unit) : NULL);
+    if (headSize) writeUnit(head.data(), headSize, 0, check.get());
+
+    if (tailSize) {
+        setDirect(false);
+        writeUnit(tail.data(), tailSize, tailOffset, NULL);
+    }
+
+    if (sync) {
+        FPQStats::Scope scope(stats, FPQStats::image, FPQStats::Write);
+        if (fdatasync(fd)) throw std::runtime_error(std::string("Unable to sync '" + path + "'!").c_str());
+    }
+
+    // the tail went through the page cache: drop it there so that the read-back comes from the device
+    if (tailSize && verify) {
+        posix_fadvise(fd, tailOffset, tailSize, POSIX_FADV_DONTNEED);
+        FPQStats::Scope scope(stats, FPQStats::image, FPQStats::Read, tailSize);
+        if (pread(fd, check->data(), tailSize, tailOffset) != (ssize_t)tailSize || memcmp(check->data(), tail.data(), tailSize))
+            throw std::runtime_error(std::string("Read-back of '" + path + "' at offset " + std::to_string(tailOffset) + " does not match!").c_str());
+    }
+}
+
+#endif
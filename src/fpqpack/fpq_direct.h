@@ -0,0 +1,85 @@
+/*
+* 	File: fpq_direct.h
+* 	Brief: O_DIRECT image writer for block devices and files
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_DIRECT_H__
+#define __FPQ_DIRECT_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "fpq_io.h"
+#include "fpq_stats.h"
+
+/* Writes an image front to back past the page cache. The image is
+ * assembled in FPQBuffer::alignment aligned buffers from a pool; every
+ * full buffer goes to one of 'depth' writer threads, so that many writes
+ * are queued on the device at once. With verify, each writer reads its
+ * range back (again with O_DIRECT, so from the device) and compares it.
+ *
+ * Everything but the end of the image is written in aligned units. The
+ * tail that does not fill a unit is written with O_DIRECT turned off and
+ * is covered by the fdatasync() in finish(), which has nothing else to
+ * flush. The header is not known until the data is done: the first unit
+ * is kept and rewritten with it at the end.
+ *
+ * Where O_DIRECT does not exist the same writer runs buffered and relies
+ * on fdatasync() alone. FPQOutput::Buffered asks for that queue on purpose
+ * and skips the sync as well: packing with digests writes in order through
+ * it whatever the output mode. */
+class FPQDirectWriter {
+    public:
+        FPQDirectWriter(const std::string &path, uint64_t imageSize, size_t bufferSize, unsigned depth, FPQOutput mode, FPQStats *stats);
+        ~FPQDirectWriter();
+        FPQDirectWriter(const FPQDirectWriter &) = delete;
+        FPQDirectWriter &operator=(const FPQDirectWriter &) = delete;
+
+        // Free space at the write position, a multiple of the block size; fill it and commit()
+        uint8_t *claim(size_t &size);
+        void commit(size_t size);
+
+        void append(const uint8_t *data, size_t size);
+
+        // Writes the rest, puts 'header' over the start of the image and waits until all of it is durable
+        void finish(const uint8_t *header, size_t headerSize);
+
+        bool isDirect(void) const { return direct; }
+        bool isBlockDevice(void) const { return blockDevice; }
+
+    private:
+        struct Job { FPQBuffer *buffer; size_t size; uint64_t offset; };
+
+        void submit(void);
+        void writeUnit(const uint8_t *data, size_t size, uint64_t offset, FPQBuffer *check);
+        void checkError(void);
+        void setDirect(bool on);
+
+        int fd;
+        std::string path;
+        uint64_t imageSize, position;
+        bool direct, blockDevice, verify, sync;
+        FPQStats *stats;
+
+        FPQBufferPool pool, checkPool;
+        FPQBuffer *current;
+        size_t used;
+        FPQBuffer head;                 // first unit of the image as produced
+        size_t headSize;
+
+        std::vector<Job> jobs;
+        std::vector<std::thread> writers;
+        std::mutex lock;
+        std::condition_variable changed;
+        unsigned busy;
+        bool stopping;
+        std::exception_ptr error;
+};
+
+#endif /* __FPQ_DIRECT_H__ */
@@ -0,0 +1,26 @@
+/*
+* 	File: fpq_format.cpp
+* 	Brief: FPQ firmware image format implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include "fpq_format.h"
+#include "fpq_io.h"
+
+
+const std::vector<std::string> FPQHeader::fileNames = { "Config","Serial","UBoot","Linux","Liteos","Rootfs" };
+const std::vector<std::string> FPQHeader::sectionFiles = { "config","serial.bin","u-boot.bin","uImage","media_app_zip.bin","rootfs.cramfs.img" };
+const std::string FPQHeader::magic("~magic~firmware~");
+const std::string FPQHeader::crcMagic("~sections~crc32~");
+const std::string FPQHeader::lzMagic("~sections~lzfpq~");
+
+
+FPQHeader FPQHeader::load(FPQFile &image, FPQEncryptor &encryptor) {
+    FPQHeader header;
+    if (image.size() < blkSize()) throw std::runtime_error(std::string("'" + image.getPath() + "' is too small!").c_str());
+    image.readAt(header.begin(), blkSize(), 0);
+    encryptor.encrypt(header.begin(), blkSize());
+    if (!header.isValid()) throw std::runtime_error("Invalid firmware magic, wrong encryption key?");
+    return header;
+}
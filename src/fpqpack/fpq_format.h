@@ -0,0 +1,334 @@
+/*
+* 	File: fpq_format.h
+* 	Brief: FPQ firmware image format: header, serial block, encryption
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_FORMAT_H__
+#define __FPQ_FORMAT_H__
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include "crc32.h"
+#include "xor.h"
+
+#define DEFAULT_SERIAL        "B00B0069"
+#define DEFAULT_BUFFER_MB     4
+
+class FPQLog {
+    public:
+        FPQLog(std::ostream *os = &std::cout) : os(os) { }
+
+        FPQLog &operator=(const FPQLog &log) { this->os = log.os; return *this; }
+
+        template<typename T>
+        void operator()(T t) { *os << t; }
+
+        template<typename F, typename T>
+        void operator()(F f, T t) { *os << f << t; }
+
+        template<typename F, typename T, typename... Args> 
+        void operator()(F f, T t, Args... args) { *os << f << t; this->operator()(args...); }
+    private:
+        std::ostream *os;
+};
+
+class FPQFile;
+class FPQEncryptor;
+
+struct FPQHeader {
+    typedef uint8_t* iterator;
+    struct _field { uint32_t size; uint32_t offset; };
+    struct _crc { uint32_t plain; uint32_t cipher; };
+
+    FPQHeader() {
+        std::copy(magic.begin(), magic.end(), firmware_magic);   
+        std::fill(begin() + magic.length(), end(), 0);
+    }
+
+    char firmware_magic[16];   
+    _field _config;
+    _field _serial;
+    _field _uboot;
+    _field _linux;
+    _field _liteos;
+    _field _rootfs;
+    // Optional extension, all zero when absent: CRC32 of every padded section before and after encryption
+    char crc_magic[16];
+    _crc _crcs[6];
+    // Optional extension, all zero when absent: bit N set if section N is stored as an FPQCompressor stream
+    char lz_magic[16];
+    uint32_t lz_sections;
+
+    enum Type { Config = 0, Serial, UBoot, Linux, LiteOS, RootFS, FileNum_ };
+
+    iterator begin(void) { return (uint8_t*)firmware_magic; }
+
+    iterator end(void) { return (uint8_t*)(firmware_magic + blkSize()); }
+
+    void setSize(FPQHeader::Type type, uint32_t size) {
+        switch(type) {
+            case Config: _config.size = align(size); break;
+            case Serial: _serial.size = align(size); break;
+            case UBoot: _uboot.size = align(size); break;
+            case Linux: _linux.size = align(size); break;
+            case LiteOS: _liteos.size = align(size); break;
+            case RootFS: _rootfs.size = align(size); break;
+            default: break;
+        }
+    }
+
+    _field &field(FPQHeader::Type type) {
+        switch(type) {
+            case Config: return _config;
+            case Serial: return _serial;
+            case UBoot: return _uboot;
+            case Linux: return _linux;
+            case LiteOS: return _liteos;
+            case RootFS: return _rootfs;
+            default: throw std::runtime_error("Invalid section type!");
+        }
+    }
+
+    const _field &field(FPQHeader::Type type) const { return const_cast<FPQHeader*>(this)->field(type); }
+
+    void updateOffsets(void) {
+        _config.offset = blkSize();
+        _serial.offset = _config.offset + _config.size;
+        _uboot.offset = _serial.offset + _serial.size;
+        _linux.offset = _uboot.offset + _uboot.size;
+        _liteos.offset = _linux.offset + _linux.size;
+        _rootfs.offset = _liteos.offset + _liteos.size;
+    }
+
+    uint32_t imageSize(void) const { return _rootfs.offset + _rootfs.size; }
+
+    bool isValid(void) const { return std::equal(magic.begin(), magic.end(), firmware_magic); }
+
+    // True if offsets are exactly what updateOffsets() produces for the stored sizes
+    bool checkLayout(void) const {
+        FPQHeader expected(*this);
+        expected.updateOffsets();
+        for (int i = 0; i < FileNum_; ++i) {
+            const _field &stored = field((Type)i);
+            const _field &wanted = expected.field((Type)i);
+            if (stored.size % blkSize() || stored.offset != wanted.offset) return false;
+        }
+        return true;
+    }
+
+    bool hasCrcs(void) const { return std::equal(crcMagic.begin(), crcMagic.end(), crc_magic); }
+
+    void setCrc(FPQHeader::Type type, uint32_t plain, uint32_t cipher) {
+        std::copy(crcMagic.begin(), crcMagic.end(), crc_magic);
+        _crcs[type] = { plain, cipher };
+    }
+
+    _crc &crc(FPQHeader::Type type) { return _crcs[type]; }
+
+    bool isCompressed(int type) const {
+        return std::equal(lzMagic.begin(), lzMagic.end(), lz_magic) && (lz_sections & (1U << type));
+    }
+
+    void setCompressed(int type, bool compressed) {
+        if (!std::equal(lzMagic.begin(), lzMagic.end(), lz_magic)) lz_sections = 0;
+        lz_sections = compressed ? (lz_sections | (1U << type)) : (lz_sections & ~(1U << type));
+        // images without compressed sections stay byte for byte what older versions wrote
+        if (lz_sections) std::copy(lzMagic.begin(), lzMagic.end(), lz_magic);
+        else std::fill(lz_magic, lz_magic + sizeof(lz_magic), 0);
+    }
+
+    // Reads and decrypts the header of a packed image
+    static FPQHeader load(FPQFile &image, FPQEncryptor &encryptor);
+
+    void dumpLog(FPQLog &log){
+        log("****************************************\n");
+        log(std::hex, "config size: 0x", _config.size, ", offset: 0x", _config.offset, "\n");
+        log("serial size: 0x", _serial.size, ", offset: 0x", _serial.offset, "\n");
+        log("uboot size: 0x", _uboot.size, ", offset: 0x", _uboot.offset, "\n");
+        log("linux size: 0x", _linux.size, ", offset: 0x", _linux.offset, "\n");
+        log("liteos size: 0x", _liteos.size, ", offset: 0x", _liteos.offset, "\n");
+        log("rootfs size: 0x", _rootfs.size, ", offset: 0x", _rootfs.offset, "\n");
+        for (int i = 0; hasCrcs() && i < FileNum_; ++i)
+            log(std::hex, getName(i), " crc plain: 0x", _crcs[i].plain, ", cipher: 0x", _crcs[i].cipher, "\n");
+        for (int i = 0; i < FileNum_; ++i)
+            if (isCompressed(i)) log(getName(i), " is compressed\n");
+        log("****************************************\n");
+    }
+    
+    static std::vector<uint8_t> makeSerial(uint32_t serial) {
+        std::vector<uint8_t> serialBlk(blkSize());
+        union { 
+            uint32_t value, crc; 
+            uint8_t bytes[sizeof(uint32_t)];
+        } _serial { serial };
+
+        auto it = serialBlk.begin();
+        while(it != serialBlk.end()) {
+            std::copy(_serial.bytes, _serial.bytes + sizeof(uint32_t), it);
+            it += sizeof(uint32_t);
+        }
+
+        _serial.crc = CRC32_Calculate(serialBlk.data(), blkSize() - sizeof(uint32_t));
+        std::copy(_serial.bytes, _serial.bytes + sizeof(uint32_t), it - sizeof(uint32_t));
+
+        return serialBlk;
+    }
+
+    // Checks a decrypted block produced by makeSerial(), returns the serial number
+    static bool checkSerial(const uint8_t *serialBlk, uint32_t &serial) {
+        uint32_t crc;
+        std::copy(serialBlk, serialBlk + sizeof(uint32_t), (uint8_t*)&serial);
+        std::copy(serialBlk + blkSize() - sizeof(uint32_t), serialBlk + blkSize(), (uint8_t*)&crc);
+
+        for (uint32_t pos = 0; pos < blkSize() - sizeof(uint32_t); pos += sizeof(uint32_t))
+            if (!std::equal(serialBlk, serialBlk + sizeof(uint32_t), serialBlk + pos)) return false;
+
+        return CRC32_Calculate(serialBlk, blkSize() - sizeof(uint32_t)) == crc;
+    }
+
+    static uint32_t align(uint32_t value) {
+        return (value % blkSize()) ? value + (blkSize() - (value % blkSize())) : value;
+    }
+
+    static uint32_t blkSize(void) {
+        return sizeof(FPQHeader);
+    }
+
+    static std::string getName(int type) { 
+        return fileNames[type]; 
+    }
+
+    static std::string getFileName(int type) { 
+        return sectionFiles[type]; 
+    }
+
+    static const std::vector<std::string> fileNames;
+    static const std::vector<std::string> sectionFiles;
+    static const std::string magic;
+    static const std::string crcMagic;
+    static const std::string lzMagic;
+
+} __attribute__((aligned(512)));
+
+class FPQSerial {
+    public:
+        FPQSerial(const std::string &serialStr) {
+            if (!isValid(serialStr)) throw std::runtime_error("Invalid serial number!");
+            serial = std::stoul(serialStr, 0, 16);
+            this->serialStr = serialStr;
+        }
+        FPQSerial() : FPQSerial(DEFAULT_SERIAL) { }
+
+        uint32_t get(void) const { return serial; }
+        std::string getStr(void) const { return serialStr; }
+
+        FPQSerial &operator=(const FPQSerial &serial) { 
+            this->serial = serial.serial; 
+            this->serialStr = serial.serialStr; 
+            return *this; 
+        }
+
+    private:
+        bool isValid(const std::string &serial) {
+            if (serial.length() != correctLen) return false;
+
+            auto validator = [](char ch) {
+                char c = std::tolower(ch);
+                if (c < '0' || c > '9')
+                    if (c < 'a' || c > 'f') return false;
+                return true;
+            };
+
+            return std::find_if_not(serial.begin(), serial.end(), validator) == serial.end();
+        }
+
+        const size_t correctLen = 8;    // strlen(DEFAULT_SERIAL)
+        uint32_t serial;
+        std::string serialStr;
+};
+
+class FPQEncryptor {
+    public:
+        FPQEncryptor() { }
+        FPQEncryptor(std::string key) {
+            if (!key.length() || sizeof(FPQHeader) % key.length())
+                throw std::runtime_error("Error! Encryption key length must be a power of 2!");
+            this->key = key;
+            // key length divides the block size, so one block of the repeated key covers any offset
+            keystream.resize(XOR_STREAM_SIZE);
+            for (size_t i = 0; i < keystream.size(); ++i) keystream[i] = key[i % key.length()];
+        }
+        FPQEncryptor &operator=(const FPQEncryptor &encryptor) { 
+            this->key = encryptor.key; 
+            this->keystream = encryptor.keystream; 
+            return *this; 
+        }
+        
+        std::string getKey(void) const { return key; }
+
+        static std::string getKernel(void) { return XOR_KernelName(); }
+
+        void encrypt(uint8_t *data, size_t size) const {
+            if (!key.length()) return;
+            XOR_Apply(data, size, keystream.data());
+        }
+
+        void encrypt(std::vector<uint8_t> &data) { encrypt(data.data(), data.size()); }
+
+        void encrypt(uint8_t *dst, const uint8_t *src, size_t size) const {
+            if (!key.length()) { if (dst != src) std::copy(src, src + size, dst); return; }
+            XOR_ApplyCopy(dst, src, size, keystream.data());
+        }
+
+        /* Encrypts and updates running CRC32 states (CRC32_Update) of the
+         * input and of the output in one pass: every tile stays in L1 from
+         * the first CRC to the second, so the data is read from memory once.
+         * dst may be src. */
+        void encrypt(uint8_t *dst, const uint8_t *src, size_t size, uint32_t &inCrc, uint32_t &outCrc) {
+            const size_t tile = 16 * XOR_STREAM_SIZE;
+            for (size_t pos = 0; pos < size; pos += tile) {
+                size_t chunk = std::min(size - pos, tile);
+                inCrc = CRC32_Update(inCrc, src + pos, chunk);
+                encrypt(dst + pos, src + pos, chunk);
+                outCrc = CRC32_Update(outCrc, dst + pos, chunk);
+            }
+        }
+
+        /* CRC32 of 'size' encrypted bytes from the CRC32 of the plain ones,
+         * size being a multiple of the block size. CRC32 is affine, so
+         * crc(p ^ k) = crc(p) ^ crc(k) ^ crc(0): no need to read the data. */
+        uint32_t cipherCrc(uint32_t plainCrc, uint64_t size) const {
+            if (!key.length() || !size) return plainCrc;
+            std::vector<uint8_t> zeros(keystream.size());
+            uint64_t count = size / keystream.size();
+            return plainCrc ^ repeatCrc(CRC32_Calculate(keystream.data(), keystream.size()), keystream.size(), count)
+                            ^ repeatCrc(CRC32_Calculate(zeros.data(), zeros.size()), zeros.size(), count);
+        }
+
+    private:
+        // CRC32 of 'count' copies of a block, by doubling
+        static uint32_t repeatCrc(uint32_t blockCrc, uint64_t blockLen, uint64_t count) {
+            uint32_t crc = 0;
+            bool empty = true;
+            for (; count; count >>= 1) {
+                if (count & 1) {
+                    crc = empty ? blockCrc : CRC32_Combine(crc, blockCrc, blockLen);
+                    empty = false;
+                }
+                blockCrc = CRC32_Combine(blockCrc, blockCrc, blockLen);
+                blockLen *= 2;
+            }
+            return crc;
+        }
+
+        std::string key;
+        std::vector<uint8_t> keystream;
+};
+
+#endif /* __FPQ_FORMAT_H__ */
@@ -0,0 +1,980 @@
+/*
+* 	File: fpq_image.cpp
+* 	Brief: Whole image operations implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <fstream>
+#include <sstream>
+#include <set>
+#include "fpqpack.h"
+
+
+// Serial block: CRC, encryption and the write are recorded separately
+static void writeSerial(FPQContext &ctx, FPQFile &output, uint32_t serial, const uint64_t *offset, FPQChunkCrcs *crcs) {
+    std::vector<uint8_t> serialBlk;
+    {
+        FPQStats::Scope scope(ctx.stats, FPQHeader::Type::Serial, FPQStats::CRC, FPQHeader::blkSize());
+        serialBlk = FPQHeader::makeSerial(serial);
+    }
+    {
+        FPQStats::Scope scope(ctx.stats, FPQHeader::Type::Serial, FPQStats::Encrypt, serialBlk.size());
+        encryptChunk(ctx.encryptor, crcs, FPQHeader::Type::Serial, 0, serialBlk.data(), serialBlk.data(), serialBlk.size());
+    }
+    FPQStats::Scope scope(ctx.stats, FPQHeader::Type::Serial, FPQStats::Write, serialBlk.size());
+    if (offset) output.writeAt(serialBlk.data(), serialBlk.size(), *offset);
+    else output.write(serialBlk);
+}
+
+// Chunks in flight for the io_uring backend
+static unsigned uringDepth(const FPQContext &ctx) { return std::max(4U, ctx.jobs); }
+
+// Section CRCs without reading the data again, from the CRC of the unpadded plain input
+static void addCachedCrcs(const FPQEncryptor &encryptor, FPQChunkCrcs &crcs, int section, uint32_t plainCrc, uint32_t size) {
+    uint32_t padded = FPQHeader::align(size);
+    if (padded != size) {
+        std::vector<uint8_t> zeros(padded - size);
+        plainCrc = CRC32_Combine(plainCrc, CRC32_Calculate(zeros.data(), zeros.size()), zeros.size());
+    }
+    crcs.add(section, 0, padded, plainCrc, encryptor.cipherCrc(plainCrc, padded));
+}
+
+// Copies the collected CRCs into the header table
+static void setHeaderCrcs(FPQHeader &header, const FPQChunkCrcs &crcs) {
+    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+        uint32_t plain = 0, cipher = 0;
+        if (crcs.get(i, plain, cipher)) header.setCrc((FPQHeader::Type)i, plain, cipher);
+    }
+}
+
+static FPQFile *openInput(FPQContext &ctx, int section, const std::string &path) {
+    FPQStats::Scope scope(ctx.stats, section, FPQStats::Open);
+    return new FPQFile(path);
+}
+
+/* Opens the given sections and fills in the sizes and offsets of the
+ * header, the serial block included: every packing path starts from the
+ * same layout */
+static void planLayout(FPQContext &ctx, std::map<int,std::string> &files, FPQHeader &header,
+                       std::map<int,std::unique_ptr<FPQFile>> &inputs) {
+    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+        if (i == FPQHeader::Type::Serial) {
+            if (ctx.debug) ctx.log(std::dec, FPQHeader::getName(i), " size is ", FPQHeader::blkSize(), " bytes, blocks: 1\n");
+            header.setSize((FPQHeader::Type)i, FPQHeader::blkSize());
+        }
+        else if (files.count(i)) {
+            inputs[i].reset(openInput(ctx, i, files[i]));
+            int blkToRead = FPQHeader::align(inputs[i]->size()) / FPQHeader::blkSize();
+            if (ctx.debug) ctx.log(std::dec, FPQHeader::getName(i), " size is ", inputs[i]->size(), " bytes, blocks: ", blkToRead, "\n");
+            header.setSize((FPQHeader::Type)i, inputs[i]->size());
+        }
+        else if (ctx.debug) ctx.log(FPQHeader::getName(i), " skipping...\n");
+    }
+    header.updateOffsets();
+}
+
+// Removes intermediate files however the operation ends
+struct FPQTempFiles {
+    ~FPQTempFiles() { for (auto &path : paths) remove(path.c_str()); }
+    std::vector<std::string> paths;
+};
+
+/* Replaces the paths of the sections selected by ctx.compress with
+ * compressed copies named after 'prefix' and flags them in the header */
+static void compressInputs(FPQContext &ctx, std::map<int,std::string> &files, FPQHeader &header,
+                           const std::string &prefix, FPQTempFiles &temps, const std::map<int,int> &streams) {
+    if (!ctx.compress) return;
+    FPQThreadPool threads(ctx.jobs);
+    FPQCompressor compressor(threads, ctx.stats);
+
+    for (auto &file : files) {
+        if (!(ctx.compress & (1U << file.first))) continue;
+        if (file.first == FPQHeader::Type::Serial) throw std::runtime_error("Serial section cannot be compressed!");
+        std::string path = prefix + "." + FPQHeader::getFileName(file.first) + ".lz";
+        temps.paths.push_back(path);
+
+        std::unique_ptr<FPQFile> input(openInput(ctx, file.first, file.second));
+        FPQFile output(path, FPQFile::OpenMode::RWCreate);
+        std::function<void(const uint8_t*, size_t)> digest;
+        if (ctx.digests) {
+            int stream = streams.at(file.first);
+            digest = [&ctx, stream](const uint8_t *data, size_t size) { ctx.digests->update(stream, data, size); };
+        }
+        uint64_t size = compressor.compress(*input, output, file.first, digest);
+        if (size > UINT32_MAX) throw std::runtime_error(std::string("Compressed '" + file.second + "' is too large!").c_str());
+        if (ctx.debug) ctx.log(std::dec, FPQHeader::getName(file.first), " compressed ", input->size(), " -> ", size, " bytes\n");
+        if (ctx.stats) ctx.stats->addSyscalls(file.first, input->syscalls() + output.syscalls());
+
+        // no block saved: the section stays raw and its digest starts over, the packer hashes raw sections itself
+        if (FPQHeader::align(size) >= FPQHeader::align(input->size())) {
+            if (ctx.debug) ctx.log(FPQHeader::getName(file.first), " kept uncompressed\n");
+            if (ctx.digests) ctx.digests->restart(streams.at(file.first));
+            continue;
+        }
+        file.second = path;
+        header.setCompressed(file.first, true);
+    }
+}
+
+// Section CRCs read ahead, for a header that has to be final before the data
+static void readCrcs(FPQContext &ctx, std::map<int,std::unique_ptr<FPQFile>> &inputs, uint32_t serial, FPQChunkCrcs &crcs) {
+    FPQBuffer buffer(ctx.bufferSize);
+    for (auto &input : inputs) {
+        FPQFile &file = *input.second;
+        FPQStats::Scope scope(ctx.stats, input.first, FPQStats::CRC, file.size());
+        uint32_t crc = CRC32_Init();
+        for (uint64_t done = 0; done < file.size(); ) {
+            size_t size = std::min<uint64_t>(buffer.size(), file.size() - done);
+            file.readAt(buffer.data(), size, done);
+            crc = CRC32_Update(crc, buffer.data(), size);
+            done += size;
+        }
+        addCachedCrcs(ctx.encryptor, crcs, input.first, CRC32_Final(crc), file.size());
+    }
+    std::vector<uint8_t> serialBlk = FPQHeader::makeSerial(serial);
+    addCachedCrcs(ctx.encryptor, crcs, FPQHeader::Type::Serial, CRC32_Calculate(serialBlk.data(), serialBlk.size()), serialBlk.size());
+}
+
+/* Front to back through FPQDirectWriter: every section is read straight
+ * into the writer's aligned buffers and encrypted there. The header goes
+ * over the placeholder block when everything else is written, or, with
+ * digests, is made final first (section CRCs read ahead) and goes first */
+static void packInOrder(FPQContext &ctx, std::map<int,std::string> &files, FPQHeader &header, uint32_t serial,
+                        const std::string &outputPath, const std::map<int,int> &streams) {
+    std::map<int,std::unique_ptr<FPQFile>> inputs;
+    FPQChunkCrcs crcs;
+    FPQChunkCrcs *sectionCrcs = ctx.checksums ? &crcs : NULL;
+    int imageStream = ctx.digests ? streams.at(FPQStats::image) : -1;
+
+    planLayout(ctx, files, header, inputs);
+
+    std::unique_ptr<FPQDirectWriter> writer;
+    {
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Open);
+        writer.reset(new FPQDirectWriter(outputPath, header.imageSize(), ctx.bufferSize, uringDepth(ctx), ctx.output, ctx.stats));
+    }
+    if (ctx.debug && ctx.output != FPQOutput::Buffered) {
+        ctx.log(std::dec, writer->isDirect() ? "Using O_DIRECT" : "O_DIRECT unavailable, using fdatasync", " output, ",
+                uringDepth(ctx), " writes in flight", ctx.output == FPQOutput::DirectVerify ? ", read back\n" : "\n");
+    }
+    if (ctx.debug && (ctx.cache || ctx.jobs > 1 || ctx.backend != FPQBackend::Stdio)) {
+        ctx.log(ctx.digests ? "Digests" : "Direct output", " ignore the cache, jobs and backend\n");
+    }
+
+    std::vector<uint8_t> headerBlk(FPQHeader::blkSize());
+    if (ctx.digests) {
+        if (sectionCrcs) readCrcs(ctx, inputs, serial, crcs);
+        sectionCrcs = NULL;
+        setHeaderCrcs(header, crcs);
+        headerBlk.assign(header.begin(), header.end());
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Header, FPQHeader::blkSize());
+        ctx.encryptor.encrypt(headerBlk);
+        ctx.digests->update(imageStream, headerBlk.data(), headerBlk.size());
+    }
+    writer->append(headerBlk.data(), headerBlk.size());
+
+    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+        if (i == FPQHeader::Type::Serial) {
+            std::vector<uint8_t> serialBlk;
+            {
+                FPQStats::Scope scope(ctx.stats, i, FPQStats::CRC, FPQHeader::blkSize());
+                serialBlk = FPQHeader::makeSerial(serial);
+            }
+            FPQStats::Scope scope(ctx.stats, i, FPQStats::Encrypt, serialBlk.size());
+            encryptChunk(ctx.encryptor, sectionCrcs, i, 0, serialBlk.data(), serialBlk.data(), serialBlk.size());
+            if (ctx.digests) ctx.digests->update(imageStream, serialBlk.data(), serialBlk.size());
+            writer->append(serialBlk.data(), serialBlk.size());
+            continue;
+        }
+        if (!inputs.count(i)) continue;
+
+        // compressed sections were hashed before compression
+        int stream = (ctx.digests && !header.isCompressed(i)) ? streams.at(i) : -1;
+        FPQFile &input = *inputs[i];
+        uint64_t size = input.size(), padded = FPQHeader::align(size);
+        for (uint64_t done = 0; done < padded; ) {
+            size_t room;
+            uint8_t *dst = writer->claim(room);
+            size_t chunk = std::min<uint64_t>(room, padded - done);
+            size_t data = done < size ? std::min<uint64_t>(chunk, size - done) : 0;
+            {
+                FPQStats::Scope scope(ctx.stats, i, FPQStats::Read, data);
+                input.read(dst, data);
+            }
+            if (stream >= 0) ctx.digests->update(stream, dst, data);
+            std::fill(dst + data, dst + chunk, 0);
+            {
+                FPQStats::Scope scope(ctx.stats, i, FPQStats::Encrypt, chunk);
+                encryptChunk(ctx.encryptor, sectionCrcs, i, done, dst, dst, chunk);
+            }
+            if (ctx.digests) ctx.digests->update(imageStream, dst, chunk);
+            writer->commit(chunk);
+            done += chunk;
+        }
+    }
+
+    if (!ctx.digests) {
+        if (sectionCrcs) setHeaderCrcs(header, crcs);
+        headerBlk.assign(header.begin(), header.end());
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Header, FPQHeader::blkSize());
+        ctx.encryptor.encrypt(headerBlk);
+    }
+    writer->finish(headerBlk.data(), headerBlk.size());
+
+    if (ctx.stats) {
+        for (auto &input : inputs) ctx.stats->addSyscalls(input.first, input.second->syscalls());
+    }
+}
+
+/* Without a key the image holds the inputs as they are, so the section
+ * data never has to enter user space: FPQFile::copyRange() moves it in
+ * the kernel (reflink, copy_file_range, sendfile). Only the zero padding
+ * tails, the serial block and the header are written from here */
+static void copyPlain(FPQContext &ctx, std::map<int,std::string> &files, FPQHeader &header, uint32_t serial,
+                      const std::string &outputPath) {
+    std::map<int,std::unique_ptr<FPQFile>> inputs;
+    planLayout(ctx, files, header, inputs);
+
+    std::unique_ptr<FPQFile> outputFile;
+    {
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Open);
+        outputFile.reset(new FPQFile(outputPath, FPQFile::OpenMode::RWCreate));
+    }
+    FPQFile &output = *outputFile;
+
+    // copyRange() falls back to the buffer only where the kernel refuses the copy
+    FPQBuffer buffer(ctx.bufferSize);
+    std::vector<uint8_t> zeros(FPQHeader::blkSize(), 0);
+    for (auto &input : inputs) {
+        FPQHeader::_field &field = header.field((FPQHeader::Type)input.first);
+        uint64_t size = input.second->size(), padded = FPQHeader::align(size);
+        std::string method;
+        {
+            FPQStats::Scope scope(ctx.stats, input.first, FPQStats::Write, size);
+            method = output.copyRange(*input.second, 0, size, field.offset, buffer);
+            if (padded != size) output.writeAt(zeros.data(), padded - size, field.offset + size);
+        }
+        if (ctx.debug) ctx.log(FPQHeader::getName(input.first), " copied using ", method, "\n");
+    }
+
+    uint64_t serialOffset = header.field(FPQHeader::Type::Serial).offset;
+    writeSerial(ctx, output, serial, &serialOffset, NULL);
+    if (ctx.debug) header.dumpLog(ctx.log);
+
+    {
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Header, FPQHeader::blkSize());
+        output.writeAt(header.begin(), FPQHeader::blkSize(), 0);
+    }
+
+    if (ctx.stats) {
+        for (auto &input : inputs) ctx.stats->addSyscalls(input.first, input.second->syscalls());
+        ctx.stats->addSyscalls(FPQStats::image, output.syscalls());
+    }
+}
+
+FPQHeader packImage(FPQContext &ctx, const std::map<int,std::string> &plainFiles, uint32_t serial, const std::string &outputPath) {
+    FPQHeader header;
+    FPQTempFiles temps;
+    std::map<int,std::string> files(plainFiles);
+    std::map<int,int> streams;
+    if (ctx.digests) {
+        for (auto &file : files) streams[file.first] = ctx.digests->open(file.second, file.first);
+        streams[FPQStats::image] = ctx.digests->open(outputPath, FPQStats::image);
+    }
+    compressInputs(ctx, files, header, outputPath, temps, streams);
+
+    if (ctx.output != FPQOutput::Buffered || ctx.digests) {
+        packInOrder(ctx, files, header, serial, outputPath, streams);
+        if (ctx.debug) header.dumpLog(ctx.log);
+        return header;
+    }
+
+    // CRCs need the data and the cache stores what it packs, both take the usual route
+    if (ctx.encryptor.getKey().empty() && !ctx.checksums && !ctx.cache) {
+        copyPlain(ctx, files, header, serial, outputPath);
+        return header;
+    }
+
+    std::unique_ptr<FPQFile> outputFile;
+    {
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Open);
+        outputFile.reset(new FPQFile(outputPath, FPQFile::OpenMode::RWCreate));
+    }
+    FPQFile &output = *outputFile;
+    std::map<int,std::unique_ptr<FPQFile>> inputs;
+    FPQChunkCrcs crcs;
+    FPQChunkCrcs *sectionCrcs = ctx.checksums ? &crcs : NULL;
+
+    if (ctx.jobs > 1 || ctx.backend != FPQBackend::Stdio || ctx.cache) {
+        // Every size is known up front, so the header is final before any data is written
+        bool mapped = (ctx.backend == FPQBackend::Mmap) && FPQMapping::supported(output);
+        planLayout(ctx, files, header, inputs);
+        for (auto &input : inputs) mapped = mapped && FPQMapping::supported(*input.second);
+
+        // Cached sections go straight to their place, only the misses are packed and then stored
+        std::unique_ptr<FPQBuffer> cacheBuffer;
+        std::map<int,std::string> cacheMisses;
+        if (ctx.cache) {
+            cacheBuffer.reset(new FPQBuffer(ctx.bufferSize));
+            output.resize(header.imageSize());
+            for (auto input = inputs.begin(); input != inputs.end(); ) {
+                FPQHeader::_field &field = header.field((FPQHeader::Type)input->first);
+                std::string key, method;
+                uint32_t plainCrc;
+                {
+                    FPQStats::Scope scope(ctx.stats, input->first, FPQStats::Read, input->second->size());
+                    key = ctx.cache->key(*input->second, ctx.encryptor, *cacheBuffer, &plainCrc);
+                }
+                {
+                    FPQStats::Scope scope(ctx.stats, input->first, FPQStats::Cache);
+                    method = ctx.cache->fetch(key, output, field.offset, field.size, *cacheBuffer);
+                    if (!method.empty()) scope.setBytes(field.size);
+                }
+                if (method.empty()) {
+                    cacheMisses[input->first] = key;
+                    ++input;
+                    continue;
+                }
+                if (ctx.debug) ctx.log(FPQHeader::getName(input->first), " from cache (", method, ")\n");
+                if (sectionCrcs) addCachedCrcs(ctx.encryptor, crcs, input->first, plainCrc, input->second->size());
+                if (ctx.stats) ctx.stats->addSyscalls(input->first, input->second->syscalls());
+                input = inputs.erase(input);
+            }
+        }
+
+        FPQThreadPool threads(ctx.jobs);
+        if (mapped) {
+            if (ctx.debug) ctx.log("Using memory mapped I/O\n");
+            std::unique_ptr<FPQMapping> outputMap;
+            {
+                FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Open);
+                output.resize(header.imageSize());
+                outputMap.reset(new FPQMapping(output, header.imageSize(), true));
+            }
+            std::vector<std::unique_ptr<FPQMapping>> inputMaps;
+            FPQMappedPacker packer(ctx.encryptor, threads, ctx.bufferSize, ctx.stats);
+            packer.setCrcs(sectionCrcs);
+            for (auto &input : inputs) {
+                {
+                    FPQStats::Scope scope(ctx.stats, input.first, FPQStats::Open);
+                    inputMaps.emplace_back(new FPQMapping(*input.second, input.second->size(), false));
+                }
+                uint8_t *dst = outputMap->data() + header.field((FPQHeader::Type)input.first).offset;
+                packer.add(inputMaps.back()->data(), inputMaps.back()->size(), dst, input.first);
+            }
+            packer.run();
+        }
+        else if (ctx.backend == FPQBackend::Uring && FPQUring::supported()) {
+            if (ctx.debug) ctx.log(std::dec, "Using io_uring, queue depth ", uringDepth(ctx), "\n");
+            FPQUringPacker packer(ctx.encryptor, ctx.bufferSize, uringDepth(ctx), ctx.stats);
+            packer.setCrcs(sectionCrcs);
+            for (auto &input : inputs) {
+                packer.add(*input.second, output, header.field((FPQHeader::Type)input.first).offset, input.first);
+            }
+            packer.run();
+        }
+        else {
+            if (ctx.backend == FPQBackend::Mmap && ctx.debug) ctx.log("Memory mapped I/O unavailable, using stdio\n");
+            if (ctx.backend == FPQBackend::Uring && ctx.debug) ctx.log("io_uring unavailable, using stdio\n");
+            FPQBufferPool pool(ctx.bufferSize, ctx.jobs);
+            FPQParallelPacker packer(ctx.encryptor, pool, threads, ctx.stats);
+            packer.setCrcs(sectionCrcs);
+            for (auto &input : inputs) {
+                packer.add(*input.second, output, header.field((FPQHeader::Type)input.first).offset, input.first);
+            }
+            packer.run();
+        }
+
+        for (auto &miss : cacheMisses) {
+            FPQHeader::_field &field = header.field((FPQHeader::Type)miss.first);
+            FPQStats::Scope scope(ctx.stats, miss.first, FPQStats::Cache, field.size);
+            ctx.cache->store(miss.second, output, field.offset, field.size, *cacheBuffer);
+        }
+
+        uint64_t serialOffset = header.field(FPQHeader::Type::Serial).offset;
+        writeSerial(ctx, output, serial, &serialOffset, sectionCrcs);
+    }
+    else {
+        FPQBufferPool pool(ctx.bufferSize, 1);
+        FPQStreamer streamer(ctx.encryptor, pool, ctx.stats);
+        streamer.setCrcs(sectionCrcs);
+        planLayout(ctx, files, header, inputs);
+        output.setPos(FPQHeader::blkSize());
+
+        // sections are contiguous, so writing them in type order lands each at its offset
+        for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+            if (i == FPQHeader::Type::Serial) writeSerial(ctx, output, serial, NULL, sectionCrcs);
+            else if (inputs.count(i)) streamer.pack(*inputs[i], output, i);
+        }
+    }
+
+    if (sectionCrcs) setHeaderCrcs(header, crcs);
+    if (ctx.debug) header.dumpLog(ctx.log);
+
+    {
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Header, FPQHeader::blkSize());
+        std::vector<uint8_t> headerBlk(header.begin(), header.end());
+        ctx.encryptor.encrypt(headerBlk);
+        output.writeAt(headerBlk.data(), headerBlk.size(), 0);
+    }
+
+    if (ctx.stats) {
+        for (auto &input : inputs) ctx.stats->addSyscalls(input.first, input.second->syscalls());
+        ctx.stats->addSyscalls(FPQStats::image, output.syscalls());
+    }
+    return header;
+}
+
+// Splits "path:SIZE", the size being decimal; anything else is a plain path
+static bool parseSectionSpec(const std::string &spec, std::string &path, uint64_t &size) {
+    size_t colon = spec.rfind(':');
+    path = spec;
+    if (colon == std::string::npos || colon + 1 == spec.length()) return false;
+    if (spec.find_first_not_of("0123456789", colon + 1) != std::string::npos) return false;
+    path = spec.substr(0, colon);
+    size = std::stoull(spec.substr(colon + 1));
+    return true;
+}
+
+bool isStreamed(const std::map<int,std::string> &files, const std::string &outputPath) {
+    std::string path;
+    uint64_t size;
+
+    if (outputPath == "-" || (pathExists(outputPath) && !regularFileSize(outputPath, size))) return true;
+    for (auto &file : files) {
+        if (parseSectionSpec(file.second, path, size) || path == "-" || !regularFileSize(path, size)) return true;
+    }
+    return false;
+}
+
+FPQHeader streamImage(FPQContext &ctx, std::map<int,std::string> &files, uint32_t serial, const std::string &outputPath) {
+    if (ctx.checksums) throw std::runtime_error("Section CRCs go into the header, streaming writes it before the data!");
+    if (ctx.compress) throw std::runtime_error("Compressed sizes are known only at the end, streaming writes the header first!");
+    FPQPacker packer(ctx.encryptor, ctx.bufferSize);
+    std::map<int,std::unique_ptr<FPQFile>> inputs;
+    packer.setSerial(serial);
+
+    for (auto &file : files) {
+        std::string path;
+        uint64_t size = 0;
+        if (!parseSectionSpec(file.second, path, size) && (path == "-" || !regularFileSize(path, size)))
+            throw std::runtime_error(std::string("Size of '" + path + "' is unknown, pass it as 'path:SIZE'!").c_str());
+        if (size > UINT32_MAX) throw std::runtime_error(std::string("'" + path + "' is too large!").c_str());
+        if (ctx.debug) ctx.log(std::dec, FPQHeader::getName(file.first), " size is ", size, " bytes (streamed)\n");
+
+        int section = file.first;
+        int stream = ctx.digests ? ctx.digests->open(path, section) : -1;
+        std::unique_ptr<FPQFile> &input = inputs[section];
+        packer.setSection((FPQHeader::Type)section, FPQSection(size, [&ctx, &input, path, section, stream](uint8_t *data, size_t size) {
+            if (!input) {
+                FPQStats::Scope scope(ctx.stats, section, FPQStats::Open);
+                input.reset(path == "-" ? new FPQFile(stdin, "stdin") : new FPQFile(path, FPQFile::OpenMode::ROpen));
+            }
+            {
+                FPQStats::Scope scope(ctx.stats, section, FPQStats::Read, size);
+                input->read(data, size);
+            }
+            if (stream >= 0) ctx.digests->update(stream, data, size);
+            return size;
+        }));
+    }
+    int imageStream = ctx.digests ? ctx.digests->open(outputPath, FPQStats::image) : -1;
+
+    std::unique_ptr<FPQFile> output;
+    {
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Open);
+        output.reset(outputPath == "-" ? new FPQFile(stdout, "stdout") : new FPQFile(outputPath, FPQFile::OpenMode::RWCreate));
+    }
+    FPQHeader header = packer.pack([&ctx, &output, imageStream](const uint8_t *data, size_t size) {
+        if (imageStream >= 0) ctx.digests->update(imageStream, data, size);
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Write, size);
+        output->write(data, size);
+    });
+    if (ctx.debug) header.dumpLog(ctx.log);
+
+    if (ctx.stats) {
+        for (auto &input : inputs) if (input.second) ctx.stats->addSyscalls(input.first, input.second->syscalls());
+        ctx.stats->addSyscalls(FPQStats::image, output->syscalls());
+    }
+    return header;
+}
+
+void unpackImage(FPQContext &ctx, const std::string &imagePath, const std::string &outputDir) {
+    FPQFile image(imagePath, FPQFile::OpenMode::ROpen);
+    FPQHeader header = FPQHeader::load(image, ctx.encryptor);
+    if (ctx.debug) header.dumpLog(ctx.log);
+
+    makeDir(outputDir);
+    FPQTempFiles temps;
+    std::map<int,std::unique_ptr<FPQFile>> outputs;
+    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+        FPQHeader::_field &field = header.field((FPQHeader::Type)i);
+        if (!field.size) continue;
+        if ((uint64_t)field.offset + field.size > image.size())
+            throw std::runtime_error(std::string(FPQHeader::getName(i) + " section is out of image bounds!").c_str());
+        // compressed sections are decrypted next to their final file and expanded at the end
+        std::string path = outputDir + "/" + FPQHeader::getFileName(i) + (header.isCompressed(i) ? ".lz" : "");
+        outputs[i].reset(new FPQFile(path, FPQFile::OpenMode::RWCreate));
+        if (header.isCompressed(i)) temps.paths.push_back(path);
+        if (ctx.debug) ctx.log(FPQHeader::getName(i), " -> '", outputs[i]->getPath(), "'\n");
+    }
+
+    bool mapped = (ctx.backend == FPQBackend::Mmap) && FPQMapping::supported(image);
+    for (auto &output : outputs) mapped = mapped && FPQMapping::supported(*output.second);
+
+    // here the packers read the ciphertext and write the plain text
+    FPQChunkCrcs crcs;
+    FPQChunkCrcs *sectionCrcs = header.hasCrcs() ? &crcs : NULL;
+    FPQThreadPool threads(ctx.jobs);
+    if (mapped) {
+        FPQMapping imageMap(image, image.size(), false);
+        std::vector<std::unique_ptr<FPQMapping>> outputMaps;
+        FPQMappedPacker unpacker(ctx.encryptor, threads, ctx.bufferSize, ctx.stats);
+        unpacker.setCrcs(sectionCrcs);
+        for (auto &output : outputs) {
+            FPQHeader::_field &field = header.field((FPQHeader::Type)output.first);
+            output.second->resize(field.size);
+            outputMaps.emplace_back(new FPQMapping(*output.second, field.size, true));
+            unpacker.add(imageMap.data() + field.offset, field.size, outputMaps.back()->data(), output.first);
+        }
+        unpacker.run();
+    }
+    else if (ctx.backend == FPQBackend::Uring && FPQUring::supported()) {
+        FPQUringPacker unpacker(ctx.encryptor, ctx.bufferSize, uringDepth(ctx), ctx.stats);
+        unpacker.setCrcs(sectionCrcs);
+        for (auto &output : outputs) {
+            FPQHeader::_field &field = header.field((FPQHeader::Type)output.first);
+            unpacker.add(image, field.offset, field.size, *output.second, 0, output.first);
+        }
+        unpacker.run();
+    }
+    else {
+        FPQBufferPool pool(ctx.bufferSize, threads.size());
+        FPQParallelPacker unpacker(ctx.encryptor, pool, threads, ctx.stats);
+        unpacker.setCrcs(sectionCrcs);
+        for (auto &output : outputs) {
+            FPQHeader::_field &field = header.field((FPQHeader::Type)output.first);
+            unpacker.add(image, field.offset, field.size, *output.second, 0, output.first);
+        }
+        unpacker.run();
+    }
+
+    if (ctx.stats) {
+        for (auto &output : outputs) ctx.stats->addSyscalls(output.first, output.second->syscalls());
+        ctx.stats->addSyscalls(FPQStats::image, image.syscalls());
+    }
+
+    for (auto &output : outputs) {
+        uint32_t cipher = 0, plain = 0;
+        if (!sectionCrcs || !crcs.get(output.first, cipher, plain)) continue;
+        FPQHeader::_crc &stored = header.crc((FPQHeader::Type)output.first);
+        if (stored.cipher != cipher || stored.plain != plain)
+            throw std::runtime_error(std::string(FPQHeader::getName(output.first) + " section CRC mismatch!").c_str());
+    }
+
+    FPQCompressor decompressor(threads, ctx.stats);
+    for (auto &output : outputs) {
+        if (!header.isCompressed(output.first)) continue;
+        FPQFile plain(outputDir + "/" + FPQHeader::getFileName(output.first), FPQFile::OpenMode::RWCreate);
+        uint64_t size = decompressor.decompress(*output.second, 0, header.field((FPQHeader::Type)output.first).size, plain, output.first);
+        if (ctx.debug) ctx.log(std::dec, FPQHeader::getName(output.first), " decompressed to ", size, " bytes\n");
+        output.second.reset();
+    }
+}
+
+FPQVerifyResult verifyImage(FPQEncryptor &encryptor, const std::string &imagePath) {
+    FPQVerifyResult result = { imagePath, "", false, false, false, false, 0, false, false };
+
+    try {
+        FPQFile image(imagePath, FPQFile::OpenMode::ROpen);
+        FPQHeader header;
+        if (image.size() < FPQHeader::blkSize()) throw std::runtime_error("image is too small");
+        image.readAt(header.begin(), FPQHeader::blkSize(), 0);
+        encryptor.encrypt(header.begin(), FPQHeader::blkSize());
+
+        result.magic = header.isValid();
+        if (!result.magic) return result;
+        result.layout = header.checkLayout();
+        result.size = header.imageSize() == image.size();
+
+        FPQHeader::_field &serialField = header.field(FPQHeader::Type::Serial);
+        if (serialField.size == FPQHeader::blkSize() && (uint64_t)serialField.offset + serialField.size <= image.size()) {
+            uint8_t serialBlk[512];
+            image.readAt(serialBlk, sizeof(serialBlk), serialField.offset);
+            encryptor.encrypt(serialBlk, sizeof(serialBlk));
+            result.serialCrc = FPQHeader::checkSerial(serialBlk, result.serial);
+        }
+
+        result.crcTable = header.hasCrcs();
+        if (result.crcTable && result.layout && result.size) {
+            FPQBuffer buffer(DEFAULT_BUFFER_MB * 1024 * 1024);
+            result.sectionCrc = true;
+            for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+                FPQHeader::_field &field = header.field((FPQHeader::Type)i);
+                if (!field.size) continue;
+                uint32_t crc = CRC32_Init();
+                for (uint64_t pos = 0; pos < field.size; pos += buffer.size()) {
+                    size_t size = std::min<uint64_t>(field.size - pos, buffer.size());
+                    image.readAt(buffer.data(), size, field.offset + pos);
+                    crc = CRC32_Update(crc, buffer.data(), size);
+                }
+                result.sectionCrc = result.sectionCrc && CRC32_Final(crc) == header.crc((FPQHeader::Type)i).cipher;
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        result.error = e.what();
+    }
+
+    return result;
+}
+
+std::string jsonEscape(const std::string &str) {
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        if ((unsigned char)c < 0x20) { escaped += ' '; continue; }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string FPQVerifyResult::toJson(void) const {
+    char serialStr[9];
+    std::ostringstream json;
+    snprintf(serialStr, sizeof(serialStr), "%08X", serial);
+    json << "{\"image\":\"" << jsonEscape(path) << "\","
+         << "\"result\":\"" << (passed() ? "pass" : "fail") << "\","
+         << "\"magic\":" << (magic ? "true" : "false") << ","
+         << "\"layout\":" << (layout ? "true" : "false") << ","
+         << "\"size\":" << (size ? "true" : "false") << ","
+         << "\"serial_crc\":" << (serialCrc ? "true" : "false") << ","
+         << "\"serial\":\"" << serialStr << "\"";
+    if (crcTable) json << ",\"section_crc\":" << (sectionCrc ? "true" : "false");
+    if (!error.empty()) json << ",\"error\":\"" << jsonEscape(error) << "\"";
+    json << "}";
+    return json.str();
+}
+
+std::vector<FPQSerial> parseSerials(const std::string &spec) {
+    std::vector<FPQSerial> serials;
+
+    if (!spec.empty() && spec[0] == '@') {
+        std::ifstream list(spec.substr(1));
+        if (!list.is_open()) throw std::runtime_error(std::string("Unable open '" + spec.substr(1) + "'!").c_str());
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(std::remove_if(line.begin(), line.end(), [](char c) { return std::isspace((unsigned char)c); }), line.end());
+            if (!line.empty()) serials.push_back(FPQSerial(line));
+        }
+    }
+    else {
+        size_t dash = spec.find('-');
+        FPQSerial first(spec.substr(0, dash));
+        FPQSerial last(dash == std::string::npos ? spec : spec.substr(dash + 1));
+        if (last.get() < first.get()) throw std::runtime_error("Invalid serial range!");
+        for (uint64_t value = first.get(); value <= last.get(); ++value) {
+            char serial[9];
+            snprintf(serial, sizeof(serial), "%08X", (uint32_t)value);
+            serials.push_back(FPQSerial(serial));
+        }
+    }
+
+    if (serials.empty()) throw std::runtime_error("No serial numbers given!");
+    return serials;
+}
+
+void batchImages(FPQContext &ctx, std::map<int,std::string> &files, const std::vector<FPQSerial> &serials, const std::string &outputDir) {
+    auto imagePath = [&outputDir](const FPQSerial &serial) { return outputDir + "/firmware_" + serial.getStr() + ".bin"; };
+    if (ctx.digests) throw std::runtime_error("Digests are taken for a single packed image only!");
+
+    makeDir(outputDir);
+    FPQHeader header = packImage(ctx, files, serials.front().get(), imagePath(serials.front()));
+    if (serials.size() == 1) return;
+
+    FPQFile base(imagePath(serials.front()), FPQFile::OpenMode::ROpen);
+    uint32_t serialOffset = header.field(FPQHeader::Type::Serial).offset;
+    FPQThreadPool threads(ctx.jobs);
+    FPQBufferPool pool(ctx.bufferSize, threads.size());
+    std::vector<std::string> methods(serials.size() - 1);
+
+    threads.run(serials.size() - 1, [&](size_t i) {
+        const FPQSerial &serial = serials[i + 1];
+        FPQFile image(imagePath(serial), FPQFile::OpenMode::RWCreate);
+        {
+            FPQBufferPool::Lease buffer(pool);
+            methods[i] = image.copyFrom(base, *buffer);
+        }
+
+        // the serial block has its own entry in the CRC table, so such clones get their own header too
+        FPQChunkCrcs crcs;
+        std::vector<uint8_t> serialBlk = FPQHeader::makeSerial(serial.get());
+        encryptChunk(ctx.encryptor, header.hasCrcs() ? &crcs : NULL, FPQHeader::Type::Serial, 0,
+                     serialBlk.data(), serialBlk.data(), serialBlk.size());
+        image.writeAt(serialBlk.data(), serialBlk.size(), serialOffset);
+
+        if (header.hasCrcs()) {
+            FPQHeader cloneHeader(header);
+            setHeaderCrcs(cloneHeader, crcs);
+            ctx.encryptor.encrypt(cloneHeader.begin(), FPQHeader::blkSize());
+            image.writeAt(cloneHeader.begin(), FPQHeader::blkSize(), 0);
+        }
+    });
+
+    if (ctx.debug) {
+        std::map<std::string,unsigned> counts;
+        for (auto &method : methods) counts[method]++;
+        for (auto &count : counts) ctx.log(std::dec, "Cloned ", count.second, " image(s) using ", count.first, "\n");
+    }
+}
+
+std::vector<FPQVariant> parseVariants(const std::string &manifestPath, const FPQVariant &defaults) {
+    const std::map<std::string,int> names = { { "c", FPQHeader::Type::Config }, { "b", FPQHeader::Type::UBoot },
+        { "x", FPQHeader::Type::Linux }, { "s", FPQHeader::Type::LiteOS }, { "f", FPQHeader::Type::RootFS } };
+    std::ifstream manifest(manifestPath);
+    if (!manifest.is_open()) throw std::runtime_error(std::string("Unable open '" + manifestPath + "'!").c_str());
+
+    std::vector<FPQVariant> variants;
+    std::string line;
+    for (unsigned number = 1; std::getline(manifest, line); ++number) {
+        std::istringstream items(line);
+        std::string item;
+        if (!(items >> item) || item[0] == '#') continue;
+
+        FPQVariant variant(defaults);
+        variant.output.clear();
+        auto error = [&](const std::string &what) {
+            return std::runtime_error(std::string(manifestPath + ":" + std::to_string(number) + ": " + what).c_str());
+        };
+        do {
+            size_t eq = item.find('=');
+            if (eq == std::string::npos) throw error("malformed field '" + item + "'");
+            std::string name = item.substr(0, eq), value = item.substr(eq + 1);
+            if (name == "o") variant.output = value;
+            else if (name == "k") variant.encryptor = value.empty() ? FPQEncryptor() : FPQEncryptor(value);
+            else if (name == "h") variant.serial = FPQSerial(value);
+            else if (names.count(name)) {
+                if (value.empty()) variant.files.erase(names.at(name));
+                else variant.files[names.at(name)] = value;
+            }
+            else throw error("unknown field '" + name + "'");
+        } while (items >> item);
+
+        if (variant.output.empty()) throw error("output is not specified");
+        if (!variant.files.count(FPQHeader::Type::Config)) throw error("config file is not specified");
+        variants.push_back(variant);
+    }
+
+    if (variants.empty()) throw std::runtime_error(std::string("No variants in '" + manifestPath + "'!").c_str());
+    return variants;
+}
+
+void buildVariants(FPQContext &ctx, const std::vector<FPQVariant> &variants) {
+    if (ctx.compress) throw std::runtime_error("Build matrix does not compress sections!");
+    if (ctx.digests) throw std::runtime_error("Digests are taken for a single packed image only!");
+    if (ctx.debug && (ctx.cache || ctx.output != FPQOutput::Buffered || ctx.backend != FPQBackend::Stdio))
+        ctx.log("Build matrix ignores the cache, output mode and backend\n");
+
+    // every distinct input with the places it goes to
+    struct Use { size_t variant; int section; };
+    std::map<std::string,std::vector<Use>> uses;
+    std::set<std::string> outputs;
+    for (size_t v = 0; v < variants.size(); ++v) {
+        if (!outputs.insert(variants[v].output).second)
+            throw std::runtime_error(std::string("Output '" + variants[v].output + "' is listed twice!").c_str());
+        for (auto &file : variants[v].files) uses[file.second].push_back({ v, file.first });
+    }
+
+    std::map<std::string,std::unique_ptr<FPQFile>> inputs;
+    for (auto &use : uses) {
+        uint64_t size;
+        if (!regularFileSize(use.first, size)) throw std::runtime_error(std::string("'" + use.first + "' is not a regular file!").c_str());
+        inputs[use.first].reset(openInput(ctx, use.second.front().section, use.first));
+    }
+
+    std::vector<FPQHeader> headers(variants.size());
+    std::vector<std::unique_ptr<FPQFile>> images(variants.size());
+    for (size_t v = 0; v < variants.size(); ++v) {
+        for (auto &file : variants[v].files) headers[v].setSize((FPQHeader::Type)file.first, inputs[file.second]->size());
+        headers[v].setSize(FPQHeader::Type::Serial, FPQHeader::blkSize());
+        headers[v].updateOffsets();
+
+        FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Open);
+        images[v].reset(new FPQFile(variants[v].output, FPQFile::OpenMode::RWCreate));
+        images[v]->resize(headers[v].imageSize());
+    }
+    if (ctx.debug) ctx.log(std::dec, variants.size(), " variant(s) from ", inputs.size(), " distinct input(s)\n");
+
+    FPQThreadPool threads(ctx.jobs);
+    FPQBufferPool pool(ctx.bufferSize, threads.size());
+    FPQBuffer first(ctx.bufferSize), second(ctx.bufferSize);
+    std::vector<FPQChunkCrcs> crcs(variants.size());
+    std::vector<FPQEncryptor> encryptors;
+    for (auto &variant : variants) encryptors.push_back(variant.encryptor);
+
+    for (auto &use : uses) {
+        FPQFile &input = *inputs[use.first];
+        int section = use.second.front().section;
+        uint64_t size = input.size(), padded = FPQHeader::align(size);
+        uint32_t plainCrc = CRC32_Init();
+
+        // a chunk of the input, zero padded to whole blocks at the end
+        auto readChunk = [&](FPQBuffer &buffer, uint64_t pos) {
+            size_t chunk = std::min<uint64_t>(buffer.size(), padded - pos), data = std::min<uint64_t>(chunk, size - pos);
+            FPQStats::Scope scope(ctx.stats, section, FPQStats::Read, data);
+            input.readAt(buffer.data(), data, pos);
+            std::fill(buffer.data() + data, buffer.data() + chunk, 0);
+        };
+        if (padded) readChunk(first, 0);
+
+        FPQBuffer *current = &first, *next = &second;
+        for (uint64_t pos = 0; pos < padded; pos += current->size(), std::swap(current, next)) {
+            size_t chunk = std::min<uint64_t>(current->size(), padded - pos);
+            size_t tasks = use.second.size();
+
+            // one task per use of the chunk, one reads the next chunk and one takes the CRC
+            threads.run(tasks + 2, [&](size_t i) {
+                if (i == tasks) {
+                    if (pos + chunk < padded) readChunk(*next, pos + chunk);
+                    return;
+                }
+                if (i == tasks + 1) {
+                    if (!ctx.checksums) return;
+                    FPQStats::Scope scope(ctx.stats, section, FPQStats::CRC, chunk);
+                    plainCrc = CRC32_Update(plainCrc, current->data(), std::min<uint64_t>(chunk, size - pos));
+                    return;
+                }
+
+                const Use &target = use.second[i];
+                FPQEncryptor &encryptor = encryptors[target.variant];
+                uint64_t offset = headers[target.variant].field((FPQHeader::Type)target.section).offset + pos;
+                if (encryptor.getKey().empty()) {
+                    FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Write, chunk);
+                    images[target.variant]->writeAt(current->data(), chunk, offset);
+                    return;
+                }
+
+                FPQBufferPool::Lease buffer(pool);
+                {
+                    FPQStats::Scope scope(ctx.stats, target.section, FPQStats::Encrypt, chunk);
+                    encryptor.encrypt(buffer->data(), current->data(), chunk);
+                }
+                FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Write, chunk);
+                images[target.variant]->writeAt(buffer->data(), chunk, offset);
+            });
+        }
+
+        if (ctx.checksums) {
+            for (auto &target : use.second)
+                addCachedCrcs(encryptors[target.variant], crcs[target.variant], target.section, CRC32_Final(plainCrc), size);
+        }
+        if (ctx.stats) ctx.stats->addSyscalls(section, input.syscalls());
+    }
+
+    // serial block and header are all that differ in the end
+    threads.run(variants.size(), [&](size_t v) {
+        FPQEncryptor &encryptor = encryptors[v];
+        FPQHeader &header = headers[v];
+        std::vector<uint8_t> serialBlk = FPQHeader::makeSerial(variants[v].serial.get());
+        encryptChunk(encryptor, ctx.checksums ? &crcs[v] : NULL, FPQHeader::Type::Serial, 0,
+                     serialBlk.data(), serialBlk.data(), serialBlk.size());
+        images[v]->writeAt(serialBlk.data(), serialBlk.size(), header.field(FPQHeader::Type::Serial).offset);
+
+        if (ctx.checksums) setHeaderCrcs(header, crcs[v]);
+        std::vector<uint8_t> headerBlk(header.begin(), header.end());
+        {
+            FPQStats::Scope scope(ctx.stats, FPQStats::image, FPQStats::Header, FPQHeader::blkSize());
+            encryptor.encrypt(headerBlk);
+        }
+        images[v]->writeAt(headerBlk.data(), headerBlk.size(), 0);
+        if (ctx.stats) ctx.stats->addSyscalls(FPQStats::image, images[v]->syscalls());
+    });
+
+    if (ctx.debug) {
+        for (size_t v = 0; v < variants.size(); ++v) ctx.log("Variant '", variants[v].output, "' packed\n");
+    }
+}
+
+void moveRange(FPQFile &file, uint64_t from, uint64_t to, uint64_t size, FPQBuffer &buffer) {
+    if (from == to) return;
+    for (uint64_t done = 0; done < size; ) {
+        uint64_t chunk = std::min<uint64_t>(size - done, buffer.size());
+        uint64_t pos = (to < from) ? done : size - done - chunk;
+        file.readAt(buffer.data(), chunk, from + pos);
+        file.writeAt(buffer.data(), chunk, to + pos);
+        done += chunk;
+    }
+}
+
+void updateImage(FPQContext &ctx, const std::string &imagePath, const std::map<int,std::string> &plainFiles, const FPQSerial *serial) {
+    if (ctx.digests) throw std::runtime_error("Digests are taken for a single packed image only!");
+    FPQTempFiles temps;
+    FPQFile image(imagePath);
+    FPQHeader oldHeader = FPQHeader::load(image, ctx.encryptor);
+    FPQHeader header(oldHeader);
+
+    if (!oldHeader.checkLayout() || oldHeader.imageSize() > image.size())
+        throw std::runtime_error("Image layout is corrupted!");
+    // the table would need every untouched section read and decrypted, that is a fresh pack
+    if (ctx.checksums && !oldHeader.hasCrcs())
+        throw std::runtime_error("The image has no section CRC table, repack it to add one!");
+
+    std::map<int,std::string> files(plainFiles);
+    for (auto &file : files) header.setCompressed(file.first, false);
+    compressInputs(ctx, files, header, imagePath, temps, std::map<int,int>());
+
+    std::map<int,std::unique_ptr<FPQFile>> inputs;
+    for (auto &file : files) {
+        inputs[file.first].reset(new FPQFile(file.second));
+        header.setSize((FPQHeader::Type)file.first, inputs[file.first]->size());
+    }
+    header.updateOffsets();
+
+    std::vector<int> leftMoves, rightMoves;
+    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+        FPQHeader::_field &from = oldHeader.field((FPQHeader::Type)i), &to = header.field((FPQHeader::Type)i);
+        if (inputs.count(i)) {
+            if (ctx.debug) ctx.log(FPQHeader::getName(i), (from.size == to.size) ? ": rewriting in place\n" : ": resizing\n");
+        }
+        else if (to.offset < from.offset) leftMoves.push_back(i);
+        else if (to.offset > from.offset) rightMoves.insert(rightMoves.begin(), i);
+    }
+
+    {
+        FPQBufferPool pool(ctx.bufferSize, 1);
+        FPQBufferPool::Lease buffer(pool);
+        leftMoves.insert(leftMoves.end(), rightMoves.begin(), rightMoves.end());
+        for (int i : leftMoves) {
+            FPQHeader::_field &from = oldHeader.field((FPQHeader::Type)i), &to = header.field((FPQHeader::Type)i);
+            if (ctx.debug) ctx.log(std::dec, FPQHeader::getName(i), ": moving ", from.size, " bytes from 0x", std::hex, from.offset, " to 0x", to.offset, "\n");
+            moveRange(image, from.offset, to.offset, from.size, *buffer);
+        }
+    }
+
+    FPQThreadPool threads(ctx.jobs);
+    FPQBufferPool pool(ctx.bufferSize, threads.size());
+    // moved sections keep their bytes and so their entries in a CRC table, replaced ones get new entries
+    FPQChunkCrcs crcs;
+    FPQChunkCrcs *sectionCrcs = header.hasCrcs() ? &crcs : NULL;
+    FPQParallelPacker packer(ctx.encryptor, pool, threads);
+    packer.setCrcs(sectionCrcs);
+    for (auto &input : inputs) {
+        packer.add(*input.second, image, header.field((FPQHeader::Type)input.first).offset, input.first);
+    }
+    packer.run();
+
+    if (serial) {
+        std::vector<uint8_t> serialBlk = FPQHeader::makeSerial(serial->get());
+        encryptChunk(ctx.encryptor, sectionCrcs, FPQHeader::Type::Serial, 0, serialBlk.data(), serialBlk.data(), serialBlk.size());
+        image.writeAt(serialBlk.data(), serialBlk.size(), header.field(FPQHeader::Type::Serial).offset);
+    }
+    if (sectionCrcs) setHeaderCrcs(header, crcs);
+
+    if (header.imageSize() != image.size()) image.resize(header.imageSize());
+    if (ctx.debug) header.dumpLog(ctx.log);
+
+    std::vector<uint8_t> headerBlk(header.begin(), header.end());
+    ctx.encryptor.encrypt(headerBlk);
+    image.writeAt(headerBlk.data(), headerBlk.size(), 0);
+}
@@ -0,0 +1,122 @@
+/*
+* 	File: fpq_image.h
+* 	Brief: Whole image operations: pack, unpack, verify, batch and repack
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_IMAGE_H__
+#define __FPQ_IMAGE_H__
+
+#include <map>
+#include "fpq_format.h"
+#include "fpq_io.h"
+#include "fpq_stats.h"
+#include "fpq_uring.h"
+#include "fpq_cache.h"
+#include "fpq_compress.h"
+#include "fpq_digest.h"
+
+struct FPQContext {
+    FPQLog log;
+    bool debug;
+    FPQEncryptor encryptor;
+    size_t bufferSize;
+    unsigned jobs;
+    FPQBackend backend;
+    FPQStats *stats;        // NULL: no instrumentation
+    FPQCache *cache;        // NULL: every section is encrypted
+    bool checksums;         // store the section CRC table in the header
+    uint32_t compress;      // bit N set: compress section N before encryption
+    FPQOutput output;       // anything but Buffered: packed through FPQDirectWriter
+    FPQDigester *digests;   // NULL: no SHA-256 of the sections and the image
+};
+
+/* Packs the given sections into outputPath, returns the final (plain) header.
+ * Sections selected by ctx.compress go through FPQCompressor into a
+ * temporary file next to the output first and are packed from there,
+ * unless that does not save a block: those stay raw.
+ * With ctx.digests every input (named by its path, hashed before
+ * compression) and then the image get a stream there; the image is then
+ * written front to back, header first, so it is hashed as it goes out. */
+FPQHeader packImage(FPQContext &ctx, const std::map<int,std::string> &plainFiles, uint32_t serial, const std::string &outputPath);
+
+/* Packs without seeking, for pipes, FIFOs and stdout: sizes come from a
+ * "path:SIZE" suffix or from the file itself, the header goes out first
+ * and everything after it strictly in order. "-" is stdin as a section
+ * and stdout as the output. Inputs are opened only when their turn
+ * comes, so one producer can feed several FIFOs one after another. */
+FPQHeader streamImage(FPQContext &ctx, std::map<int,std::string> &files, uint32_t serial, const std::string &outputPath);
+
+// True if packImage() cannot be used: stdin/stdout, explicit sizes or files that are not regular
+bool isStreamed(const std::map<int,std::string> &files, const std::string &outputPath);
+
+/* Decrypts every non-empty section of a packed image into its own file.
+ * Sections keep their 512-byte padding: the image does not store the
+ * original lengths. Compressed sections do store them and come out
+ * exactly as they went in. */
+void unpackImage(FPQContext &ctx, const std::string &imagePath, const std::string &outputDir);
+
+struct FPQVerifyResult {
+    std::string path;
+    std::string error;
+    bool magic, layout, size, serialCrc;
+    uint32_t serial;
+    bool crcTable, sectionCrc;
+
+    bool passed(void) const { return error.empty() && magic && layout && size && serialCrc && (!crcTable || sectionCrc); }
+
+    // One JSON object on one line
+    std::string toJson(void) const;
+};
+
+std::string jsonEscape(const std::string &str);
+
+/* Reads the header and the serial block only: two blocks per image no matter
+ * its size. Images with a section CRC table are also read through once to
+ * check the stored (encrypted) bytes, nothing is decrypted for that. */
+FPQVerifyResult verifyImage(FPQEncryptor &encryptor, const std::string &imagePath);
+
+// 'FIRST-LAST' hex range, a single serial or '@file' with a serial per line
+std::vector<FPQSerial> parseSerials(const std::string &spec);
+
+/* Packs the first image normally, then clones it for every other serial
+ * and rewrites only its serial block. The header does not depend on the
+ * serial, so clones share everything else byte for byte. */
+void batchImages(FPQContext &ctx, std::map<int,std::string> &files, const std::vector<FPQSerial> &serials, const std::string &outputDir);
+
+// One product variant of a build matrix
+struct FPQVariant {
+    std::string output;
+    std::map<int,std::string> files;
+    FPQEncryptor encryptor;
+    FPQSerial serial;
+};
+
+/* Variants from a manifest, one per line as whitespace separated fields:
+ * o=OUTPUT, c= b= x= s= f= section paths, k=KEY and h=SERIAL. Whatever a
+ * line leaves out comes from 'defaults', an empty value drops a section.
+ * Blank lines and lines starting with '#' are skipped. */
+std::vector<FPQVariant> parseVariants(const std::string &manifestPath, const FPQVariant &defaults);
+
+/* Packs every variant in one pass over the inputs: each distinct input
+ * file is read once, chunk by chunk, and every chunk is encrypted for all
+ * variants that use it in parallel (one task per use), while the next
+ * chunk is read. Section CRCs (ctx.checksums) come from one CRC of the
+ * plain input per file. ctx.encryptor is not used, every variant has its
+ * own key. */
+void buildVariants(FPQContext &ctx, const std::vector<FPQVariant> &variants);
+
+// Moves a byte range inside one file, overlapping ranges are allowed
+void moveRange(FPQFile &file, uint64_t from, uint64_t to, uint64_t size, FPQBuffer &buffer);
+
+/* Replaces sections of an existing image, new ones are compressed as
+ * ctx.compress says. A section whose aligned size is unchanged is
+ * rewritten in place. Otherwise the other sections are moved to their
+ * new offsets as they are: the keystream restarts at every
+ * block, so encrypted blocks can be moved without decrypting them. The
+ * result is identical to a fresh pack. An existing CRC table is kept up
+ * to date; ctx.checksums on an image without one is an error. */
+void updateImage(FPQContext &ctx, const std::string &imagePath, const std::map<int,std::string> &plainFiles, const FPQSerial *serial);
+
+#endif /* __FPQ_IMAGE_H__ */
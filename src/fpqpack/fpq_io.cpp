@@ -0,0 +1,342 @@
+/*
+* 	File: fpq_io.cpp
+* 	Brief: File, memory and thread primitives implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <cstdlib>
+#include "fpq_io.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <io.h>
+    #include <direct.h>
+    #include <process.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <cerrno>
+#else
+    #include <unistd.h>
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #ifdef __linux__
+        #include <sys/ioctl.h>
+        #include <linux/fs.h>
+        #include <sys/sendfile.h>
+    #endif
+#endif
+
+
+FPQBackend parseBackend(const std::string &name) {
+    if (name == "stdio") return FPQBackend::Stdio;
+    if (name == "mmap") return FPQBackend::Mmap;
+    if (name == "uring") return FPQBackend::Uring;
+    throw std::runtime_error("Unknown I/O backend '" + name + "'!");
+}
+
+FPQOutput parseOutput(const std::string &name) {
+    if (name == "buffered") return FPQOutput::Buffered;
+    if (name == "direct") return FPQOutput::Direct;
+    if (name == "verify") return FPQOutput::DirectVerify;
+    throw std::runtime_error("Unknown output mode '" + name + "'!");
+}
+
+void makeDir(const std::string &path) {
+    #ifdef _WIN32
+        int rc = _mkdir(path.c_str());
+    #else
+        int rc = mkdir(path.c_str(), 0755);
+    #endif
+    if (rc && errno != EEXIST) throw std::runtime_error(std::string("Unable to create '" + path + "'!").c_str());
+}
+
+bool pathExists(const std::string &path) {
+    #ifdef _WIN32
+        struct _stat64 st;
+        return !_stat64(path.c_str(), &st);
+    #else
+        struct stat st;
+        return !stat(path.c_str(), &st);
+    #endif
+}
+
+bool sameFile(const std::string &first, const std::string &second) {
+    #ifdef _WIN32
+        // no inode numbers here: compare the absolute paths, the filesystem ignores case
+        char a[_MAX_PATH], b[_MAX_PATH];
+        if (!pathExists(first) || !pathExists(second) || !_fullpath(a, first.c_str(), sizeof(a)) || !_fullpath(b, second.c_str(), sizeof(b)))
+            return false;
+        return !_stricmp(a, b);
+    #else
+        struct stat a, b;
+        if (stat(first.c_str(), &a) || stat(second.c_str(), &b)) return false;
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    #endif
+}
+
+std::string tempPath(const std::string &path) {
+    #ifdef _WIN32
+        return path + ".tmp" + std::to_string(_getpid());
+    #else
+        return path + ".tmp" + std::to_string(getpid());
+    #endif
+}
+
+void replaceFile(const std::string &from, const std::string &to) {
+    #ifdef _WIN32
+        bool ok = MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING);
+    #else
+        bool ok = !rename(from.c_str(), to.c_str());
+    #endif
+    if (!ok) throw std::runtime_error(std::string("Unable to replace '" + to + "'!").c_str());
+}
+
+bool regularFileSize(const std::string &path, uint64_t &size) {
+    #ifdef _WIN32
+        struct _stat64 st;
+        if (_stat64(path.c_str(), &st) || !(st.st_mode & _S_IFREG)) return false;
+    #else
+        struct stat st;
+        if (stat(path.c_str(), &st) || !S_ISREG(st.st_mode)) return false;
+    #endif
+    size = st.st_size;
+    return true;
+}
+
+FPQFile::FPQFile(FILE *stream, std::string name) : file(stream), path(name), fileSize(0), calls(0), owned(false) {
+    #ifdef _WIN32
+        _setmode(_fileno(stream), _O_BINARY);
+    #endif
+}
+
+bool FPQFile::isRegular(void) const {
+    #ifdef _WIN32
+        return GetFileType((HANDLE)_get_osfhandle(_fileno(file))) == FILE_TYPE_DISK;
+    #else
+        struct stat st;
+        return !fstat(fileno(file), &st) && S_ISREG(st.st_mode);
+    #endif
+}
+
+void FPQFile::resize(uint64_t size) {
+    fflush(file);
+    calls += 2;
+    #ifdef _WIN32
+        bool ok = !_chsize_s(_fileno(file), size);
+    #else
+        posix_fallocate(fileno(file), 0, size);
+        bool ok = !ftruncate(fileno(file), size);
+    #endif
+    if (!ok) throw std::runtime_error(std::string("Unable to resize '" + path + "'!").c_str());
+    fileSize = size;
+}
+
+bool FPQFile::transferAt(uint8_t *data, size_t size, uint64_t offset, bool write) {
+    if (fflush(file)) return false;     // positional I/O bypasses the stdio buffer
+    while (size) {
+    #ifdef _WIN32
+        HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+        OVERLAPPED ov = {};
+        DWORD done = 0, chunk = (DWORD)std::min<size_t>(size, 1UL << 30);
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        calls++;
+        BOOL ok = write ? WriteFile(handle, data, chunk, &done, &ov) : ReadFile(handle, data, chunk, &done, &ov);
+        if (!ok || !done) return false;
+    #else
+        calls++;
+        ssize_t done = write ? pwrite(fileno(file), data, size, offset) : pread(fileno(file), data, size, offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return false;
+    #endif
+        data += done;
+        size -= done;
+        offset += done;
+    }
+    return true;
+}
+
+std::string FPQFile::copyFrom(FPQFile &source, FPQBuffer &buffer) {
+    fflush(file);
+    fflush(source.file);
+
+    #ifdef __linux__
+        calls++;
+        if (!ioctl(fileno(file), FICLONE, source.handle())) {
+            fileSize = source.size();
+            return "reflink";
+        }
+    #endif
+
+    return copyRange(source, 0, source.size(), 0, buffer);
+}
+
+std::string FPQFile::copyRange(FPQFile &source, uint64_t srcOffset, uint64_t size, uint64_t dstOffset, FPQBuffer &buffer) {
+    std::string method = "buffered";
+    fflush(file);
+    fflush(source.file);
+
+    #ifdef __linux__
+        struct file_clone_range range = { source.handle(), srcOffset, size, dstOffset };
+        loff_t in = srcOffset, out = dstOffset;
+        calls++;
+        if (!ioctl(fileno(file), FICLONERANGE, &range)) {
+            in += size;
+            method = "reflink";
+        }
+        while ((uint64_t)in < srcOffset + size) {
+            calls++;
+            ssize_t done = copy_file_range(source.handle(), &in, fileno(file), &out, srcOffset + size - in, 0);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) break;
+            method = "copy_file_range";
+        }
+        // kernels without cross-filesystem copy_file_range still do sendfile between files, at the file position
+        if ((uint64_t)in < srcOffset + size && lseek(fileno(file), out, SEEK_SET) == out) {
+            while ((uint64_t)in < srcOffset + size) {
+                calls++;
+                ssize_t done = sendfile(fileno(file), source.handle(), &in, std::min<uint64_t>(srcOffset + size - in, 1UL << 30));
+                if (done < 0 && errno == EINTR) continue;
+                if (done <= 0) break;
+                method = "sendfile";
+            }
+            fseek(file, 0L, SEEK_SET);
+        }
+        uint64_t copied = in - srcOffset;
+    #else
+        uint64_t copied = 0;
+    #endif
+
+    for (uint64_t pos = copied; pos < size; pos += buffer.size()) {
+        size_t chunk = std::min<uint64_t>(size - pos, buffer.size());
+        source.readAt(buffer.data(), chunk, srcOffset + pos);
+        writeAt(buffer.data(), chunk, dstOffset + pos);
+        method = "buffered";
+    }
+    fileSize = std::max<uint64_t>(fileSize, dstOffset + size);
+    return method;
+}
+
+FPQMapping::FPQMapping(FPQFile &file, size_t size, bool writable) : ptr(NULL), length(size) {
+    #ifdef _WIN32
+        throw std::runtime_error("Memory mapped I/O is not supported!");
+    #else
+        if (!size) return;
+        void *mem = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file.handle(), 0);
+        if (mem == MAP_FAILED) throw std::runtime_error(std::string("Unable to map '" + file.getPath() + "'!").c_str());
+        ptr = (uint8_t*)mem;
+        madvise(ptr, size, MADV_SEQUENTIAL);
+    #endif
+}
+
+FPQMapping::~FPQMapping() {
+    #ifndef _WIN32
+        if (ptr) munmap(ptr, length);
+    #endif
+}
+
+bool FPQMapping::supported(const FPQFile &file) {
+    #ifdef _WIN32
+        return false;
+    #else
+        return file.isRegular();
+    #endif
+}
+
+std::atomic<uint64_t> FPQBuffer::allocCount(0), FPQBuffer::allocBytes(0);
+
+FPQBuffer::FPQBuffer(size_t size) : ptr(NULL), bufSize(size) {
+    #ifdef _WIN32
+        ptr = (uint8_t*)_aligned_malloc(size, alignment);
+    #else
+        void *mem = NULL;
+        if (!posix_memalign(&mem, alignment, size)) ptr = (uint8_t*)mem;
+    #endif
+    if (!ptr) throw std::runtime_error("Unable to allocate I/O buffer!");
+    allocCount++;
+    allocBytes += size;
+}
+
+FPQBuffer::~FPQBuffer() {
+    #ifdef _WIN32
+        _aligned_free(ptr);
+    #else
+        free(ptr);
+    #endif
+}
+
+FPQThreadPool::FPQThreadPool(unsigned threads) : threads(threads ? threads : 1), task(NULL), count(0), next(0), batch(0),
+    active(0), stopping(false) {
+    for (unsigned t = 1; t < this->threads; ++t) {
+        workers.emplace_back([this]() {
+            uint64_t seen = 0;
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                started.wait(guard, [this, &seen]() { return stopping || batch != seen; });
+                if (stopping) return;
+                seen = batch;
+                active++;
+                guard.unlock();
+                work();
+                guard.lock();
+                if (!--active) finished.notify_all();
+            }
+        });
+    }
+}
+
+FPQThreadPool::~FPQThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+// Takes tasks of the current batch until none are left, a failure ends the batch for everyone
+void FPQThreadPool::work(void) {
+    for (size_t i = next++; i < count; i = next++) {
+        try {
+            (*task)(i);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!error) error = std::current_exception();
+            next = count;
+        }
+    }
+}
+
+void FPQThreadPool::run(size_t count, const std::function<void(size_t)> &task) {
+    std::lock_guard<std::mutex> serial(runLock);
+    {
+        // a worker that woke up late for the previous batch finds it drained, it must be out before the next one is set
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this]() { return !active; });
+        this->task = &task;
+        this->count = count;
+        next = 0;
+        error = nullptr;
+        if (count > 1) batch++;
+    }
+    if (count > 1) started.notify_all();
+    work();
+
+    std::exception_ptr failure;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this]() { return !active; });
+        failure = error;
+        error = nullptr;
+        this->task = NULL;
+        this->count = 0;
+    }
+    if (failure) std::rethrow_exception(failure);
+}
@@ -0,0 +1,252 @@
+/*
+* 	File: fpq_io.h
+* 	Brief: File, memory and thread primitives used by the packing pipeline
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_IO_H__
+#define __FPQ_IO_H__
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include "fpq_format.h"
+
+class FPQBuffer;
+
+enum class FPQBackend { Stdio, Mmap, Uring };
+
+FPQBackend parseBackend(const std::string &name);
+
+// How the packed image reaches the output: through the page cache, or with O_DIRECT and optionally read back
+enum class FPQOutput { Buffered, Direct, DirectVerify };
+
+FPQOutput parseOutput(const std::string &name);
+
+void makeDir(const std::string &path);
+
+bool pathExists(const std::string &path);
+
+// True if both paths exist and are one file, links and other spellings of the path included
+bool sameFile(const std::string &first, const std::string &second);
+
+// 'path' with a per-process suffix: written first, then moved over 'path' with replaceFile()
+std::string tempPath(const std::string &path);
+
+void replaceFile(const std::string &from, const std::string &to);
+
+// Size of a regular file; false for a missing path or anything else (pipes, sockets, devices)
+bool regularFileSize(const std::string &path, uint64_t &size);
+
+class FPQFile {
+    public:
+        enum class OpenMode {RWOpen, RWCreate, ROpen};
+
+        explicit FPQFile(std::string path, FPQFile::OpenMode mode) : file(NULL), fileSize(0), calls(2), owned(true) {
+            const char *modes[] = { "r+b", "w+b", "rb" };
+            file = fopen(path.c_str(), modes[(int)mode]);
+            if (!file) throw std::runtime_error(std::string("Unable open '" + path + "'!").c_str());       
+            if (!fseek(file, 0L, SEEK_END)) {
+                fileSize = ftell(file);
+                fseek(file, 0L, SEEK_SET);
+            }
+            this->path = path;
+        }
+        explicit FPQFile(std::string path) : FPQFile(path, FPQFile::OpenMode::RWOpen) {}
+        // Wraps a stream that stays open, stdin or stdout: sequential read() and write() only
+        explicit FPQFile(FILE *stream, std::string name);
+        ~FPQFile() { if (file) owned ? fclose(file) : fflush(file); }
+
+        void setPos(long offset) { calls++; fseek(file, offset, SEEK_SET); }
+
+        unsigned size() const { return fileSize; }
+
+        std::string getPath(void) const { return path; }
+
+        // I/O calls issued through this file, open and size probe included; a stdio call counts as one
+        uint64_t syscalls(void) const { return calls; }
+
+        int handle(void) const { return fileno(file); }
+
+        bool isRegular(void) const;
+
+        // Sets the file length, reserving the blocks up front where the filesystem allows it
+        void resize(uint64_t size);
+
+        // Copies the whole source file: reflink, then in-kernel copy, then through the buffer
+        std::string copyFrom(FPQFile &source, FPQBuffer &buffer);
+
+        // Same for a range, reflink works only where both offsets suit the filesystem block size;
+        // copy_file_range and sendfile come next, so that the data stays in the kernel
+        std::string copyRange(FPQFile &source, uint64_t srcOffset, uint64_t size, uint64_t dstOffset, FPQBuffer &buffer);
+
+        void read(uint8_t *data, unsigned size) {
+            calls++;
+            if (fread(data, sizeof(uint8_t), size, file) != size)
+                throw std::runtime_error(std::string("Unable to read from '" + path + "'!").c_str());
+        }
+
+        void write(const uint8_t *data, size_t size) {
+            calls++;
+            if (fwrite(data, sizeof(uint8_t), size, file) != size)
+                throw std::runtime_error(std::string("Unable to write to '" + path + "'!").c_str());
+        }
+
+        void write(std::vector<uint8_t> &data) { write(data.data(), data.size()); }
+
+        // Positional I/O: does not move the stream position, safe to call from several threads
+        void readAt(uint8_t *data, size_t size, uint64_t offset) {
+            if (!transferAt(data, size, offset, false))
+                throw std::runtime_error(std::string("Unable to read from '" + path + "'!").c_str());
+        }
+
+        void writeAt(const uint8_t *data, size_t size, uint64_t offset) {
+            if (!transferAt(const_cast<uint8_t*>(data), size, offset, true))
+                throw std::runtime_error(std::string("Unable to write to '" + path + "'!").c_str());
+        }
+
+    private:
+        bool transferAt(uint8_t *data, size_t size, uint64_t offset, bool write);
+
+        FILE *file;
+        std::string path;
+        unsigned fileSize;
+        std::atomic<uint64_t> calls;
+        bool owned;
+};
+
+class FPQMapping {
+    public:
+        FPQMapping(FPQFile &file, size_t size, bool writable);
+        ~FPQMapping();
+        FPQMapping(const FPQMapping &) = delete;
+        FPQMapping &operator=(const FPQMapping &) = delete;
+
+        uint8_t *data(void) { return ptr; }
+        size_t size(void) const { return length; }
+
+        static bool supported(const FPQFile &file);
+
+    private:
+        uint8_t *ptr;
+        size_t length;
+};
+
+class FPQBuffer {
+    public:
+        explicit FPQBuffer(size_t size);
+        ~FPQBuffer();
+        FPQBuffer(const FPQBuffer &) = delete;
+        FPQBuffer &operator=(const FPQBuffer &) = delete;
+
+        uint8_t *data(void) { return ptr; }
+        size_t size(void) const { return bufSize; }
+
+        static const size_t alignment = 4096;
+
+        // Process-wide totals, read by FPQStats
+        static uint64_t allocations(void) { return allocCount; }
+        static uint64_t allocatedBytes(void) { return allocBytes; }
+
+    private:
+        static std::atomic<uint64_t> allocCount, allocBytes;
+
+        uint8_t *ptr;
+        size_t bufSize;
+};
+
+class FPQBufferPool {
+    public:
+        FPQBufferPool(size_t bufSize, unsigned count) {
+            if (!bufSize || bufSize % FPQHeader::blkSize())
+                throw std::runtime_error("Buffer size must be a multiple of the block size!");
+            while (count--) {
+                buffers.emplace_back(new FPQBuffer(bufSize));
+                freeList.push_back(buffers.back().get());
+            }
+        }
+
+        // Blocks until a buffer is free, so memory use never exceeds the pool
+        FPQBuffer *acquire(void) {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]() { return !freeList.empty(); });
+            FPQBuffer *buffer = freeList.back();
+            freeList.pop_back();
+            return buffer;
+        }
+
+        void release(FPQBuffer *buffer) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeList.push_back(buffer);
+            }
+            available.notify_one();
+        }
+
+        size_t bufferSize(void) const { return buffers.front()->size(); }
+
+        class Lease {
+            public:
+                explicit Lease(FPQBufferPool &pool) : pool(pool), buffer(pool.acquire()) { }
+                ~Lease() { pool.release(buffer); }
+                Lease(const Lease &) = delete;
+                Lease &operator=(const Lease &) = delete;
+
+                FPQBuffer *operator->() const { return buffer; }
+                FPQBuffer &operator*() const { return *buffer; }
+
+            private:
+                FPQBufferPool &pool;
+                FPQBuffer *buffer;
+        };
+
+    private:
+        std::vector<std::unique_ptr<FPQBuffer>> buffers;
+        std::vector<FPQBuffer*> freeList;
+        std::mutex mutex;
+        std::condition_variable available;
+};
+
+/* Keeps size() - 1 workers for its lifetime, the thread calling run()
+ * is the last one, so that callers running many short batches do not
+ * start threads for each. One batch runs at a time; a task must not
+ * call run() on its own pool. */
+class FPQThreadPool {
+    public:
+        explicit FPQThreadPool(unsigned threads);
+        ~FPQThreadPool();
+        FPQThreadPool(const FPQThreadPool &) = delete;
+        FPQThreadPool &operator=(const FPQThreadPool &) = delete;
+
+        unsigned size(void) const { return threads; }
+
+        // Runs task(0) .. task(count - 1) on up to size() threads, rethrows the first failure
+        void run(size_t count, const std::function<void(size_t)> &task);
+
+    private:
+        void work(void);
+
+        unsigned threads;
+        std::vector<std::thread> workers;
+        std::mutex runLock, lock;
+        std::condition_variable started, finished;
+        const std::function<void(size_t)> *task;
+        size_t count;
+        std::atomic<size_t> next;
+        uint64_t batch;
+        unsigned active;
+        bool stopping;
+        std::exception_ptr error;
+};
+
+#endif /* __FPQ_IO_H__ */
@@ -0,0 +1,206 @@
+/*
+* 	File: fpq_pipeline.h
+* 	Brief: Section streaming: buffered, parallel and memory mapped packers
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_PIPELINE_H__
+#define __FPQ_PIPELINE_H__
+
+#include "fpq_format.h"
+#include "fpq_io.h"
+#include "fpq_stats.h"
+
+#include <map>
+
+/* Section CRC32s of what a packer reads and of what it writes, combined
+ * from chunk CRCs that may arrive in any order. Chunks are ordered by
+ * their output position. */
+class FPQChunkCrcs {
+    public:
+        void add(int section, uint64_t order, uint64_t size, uint32_t inCrc, uint32_t outCrc) {
+            std::lock_guard<std::mutex> guard(lock);
+            chunks[section][order] = { size, inCrc, outCrc };
+        }
+
+        bool get(int section, uint32_t &inCrc, uint32_t &outCrc) const {
+            auto found = chunks.find(section);
+            if (found == chunks.end()) return false;
+            bool first = true;
+            for (auto &chunk : found->second) {
+                const Chunk &c = chunk.second;
+                inCrc = first ? c.inCrc : CRC32_Combine(inCrc, c.inCrc, c.size);
+                outCrc = first ? c.outCrc : CRC32_Combine(outCrc, c.outCrc, c.size);
+                first = false;
+            }
+            return true;
+        }
+
+    private:
+        struct Chunk { uint64_t size; uint32_t inCrc, outCrc; };
+
+        std::map<int,std::map<uint64_t,Chunk>> chunks;
+        std::mutex lock;
+};
+
+// Encrypts one chunk, through the fused CRC kernel when its CRCs are wanted
+inline void encryptChunk(FPQEncryptor &encryptor, FPQChunkCrcs *crcs, int section, uint64_t order,
+                         uint8_t *dst, const uint8_t *src, size_t size) {
+    if (!crcs) {
+        encryptor.encrypt(dst, src, size);
+        return;
+    }
+    uint32_t inCrc = CRC32_Init(), outCrc = CRC32_Init();
+    encryptor.encrypt(dst, src, size, inCrc, outCrc);
+    crcs->add(section, order, size, CRC32_Final(inCrc), CRC32_Final(outCrc));
+}
+
+/* Moves a whole section from input to output through pooled buffers:
+ * every chunk is read in one call, zero padded up to the block size,
+ * encrypted in place and written in one call. */
+class FPQStreamer {
+    public:
+        FPQStreamer(FPQEncryptor &encryptor, FPQBufferPool &pool, FPQStats *stats = NULL)
+            : encryptor(encryptor), pool(pool), stats(stats), crcs(NULL) { }
+
+        void setCrcs(FPQChunkCrcs *crcs) { this->crcs = crcs; }
+
+        uint32_t pack(FPQFile &input, FPQFile &output, int section = FPQStats::image) {
+            FPQBufferPool::Lease buffer(pool);
+            uint32_t remaining = input.size(), written = 0;
+
+            while (remaining) {
+                uint32_t bytesToRead = std::min<size_t>(remaining, buffer->size());
+                uint32_t bytesToWrite = FPQHeader::align(bytesToRead);
+
+                {
+                    FPQStats::Scope scope(stats, section, FPQStats::Read, bytesToRead);
+                    input.read(buffer->data(), bytesToRead);
+                }
+                {
+                    FPQStats::Scope scope(stats, section, FPQStats::Encrypt, bytesToWrite);
+                    std::fill(buffer->data() + bytesToRead, buffer->data() + bytesToWrite, 0);
+                    encryptChunk(encryptor, crcs, section, written, buffer->data(), buffer->data(), bytesToWrite);
+                }
+                {
+                    FPQStats::Scope scope(stats, section, FPQStats::Write, bytesToWrite);
+                    output.write(buffer->data(), bytesToWrite);
+                }
+
+                remaining -= bytesToRead;
+                written += bytesToWrite;
+            }
+
+            return written;
+        }
+
+    private:
+        FPQEncryptor &encryptor;
+        FPQBufferPool &pool;
+        FPQStats *stats;
+        FPQChunkCrcs *crcs;
+};
+
+/* Parallel variant of FPQStreamer: sections are split into buffer-sized
+ * chunks, each chunk goes from its input offset straight to its final
+ * output offset with positional I/O, so chunks can be done in any order. */
+class FPQParallelPacker {
+    public:
+        FPQParallelPacker(FPQEncryptor &encryptor, FPQBufferPool &pool, FPQThreadPool &threads, FPQStats *stats = NULL)
+            : encryptor(encryptor), pool(pool), threads(threads), stats(stats), crcs(NULL) { }
+
+        void setCrcs(FPQChunkCrcs *crcs) { this->crcs = crcs; }
+
+        // Queues 'size' bytes of input at srcOffset, padded to the block size, for output at dstOffset
+        void add(FPQFile &input, uint64_t srcOffset, uint32_t size, FPQFile &output, uint64_t dstOffset, int section = FPQStats::image) {
+            for (uint64_t pos = 0; pos < size; pos += pool.bufferSize()) {
+                uint32_t chunk = std::min<uint64_t>(size - pos, pool.bufferSize());
+                tasks.push_back({ &input, srcOffset + pos, &output, dstOffset + pos, chunk, section });
+            }
+        }
+
+        void add(FPQFile &input, FPQFile &output, uint64_t offset, int section = FPQStats::image) {
+            add(input, 0, input.size(), output, offset, section);
+        }
+
+        void run(void) {
+            threads.run(tasks.size(), [this](size_t i) {
+                const Task &task = tasks[i];
+                FPQBufferPool::Lease buffer(pool);
+                uint32_t bytesToWrite = FPQHeader::align(task.size);
+
+                {
+                    FPQStats::Scope scope(stats, task.section, FPQStats::Read, task.size);
+                    task.input->readAt(buffer->data(), task.size, task.srcOffset);
+                }
+                {
+                    FPQStats::Scope scope(stats, task.section, FPQStats::Encrypt, bytesToWrite);
+                    std::fill(buffer->data() + task.size, buffer->data() + bytesToWrite, 0);
+                    encryptChunk(encryptor, crcs, task.section, task.dstOffset, buffer->data(), buffer->data(), bytesToWrite);
+                }
+                {
+                    FPQStats::Scope scope(stats, task.section, FPQStats::Write, bytesToWrite);
+                    task.output->writeAt(buffer->data(), bytesToWrite, task.dstOffset);
+                }
+            });
+            tasks.clear();
+        }
+
+    private:
+        struct Task { FPQFile *input; uint64_t srcOffset; FPQFile *output; uint64_t dstOffset; uint32_t size; int section; };
+
+        FPQEncryptor &encryptor;
+        FPQBufferPool &pool;
+        FPQThreadPool &threads;
+        FPQStats *stats;
+        FPQChunkCrcs *crcs;
+        std::vector<Task> tasks;
+};
+
+/* Zero-copy variant of FPQParallelPacker: the encryptor reads from the
+ * input mapping and writes to the output mapping directly. Only the
+ * padded last block of a section goes through a bounce block. */
+class FPQMappedPacker {
+    public:
+        FPQMappedPacker(FPQEncryptor &encryptor, FPQThreadPool &threads, size_t chunkSize, FPQStats *stats = NULL)
+            : encryptor(encryptor), threads(threads), chunkSize(chunkSize), stats(stats), crcs(NULL) { }
+
+        void setCrcs(FPQChunkCrcs *crcs) { this->crcs = crcs; }
+
+        void add(const uint8_t *src, size_t size, uint8_t *dst, int section = FPQStats::image) {
+            for (size_t pos = 0; pos < size; pos += chunkSize) {
+                tasks.push_back({ src + pos, dst + pos, std::min(size - pos, chunkSize), section });
+            }
+        }
+
+        void run(void) {
+            threads.run(tasks.size(), [this](size_t i) {
+                const Task &task = tasks[i];
+                size_t whole = task.size - task.size % FPQHeader::blkSize();
+                // page faults on both mappings are the reads and writes here
+                FPQStats::Scope scope(stats, task.section, FPQStats::Encrypt, task.size);
+
+                encryptChunk(encryptor, crcs, task.section, (uintptr_t)task.dst, task.dst, task.src, whole);
+                if (whole != task.size) {
+                    std::vector<uint8_t> lastBlk(FPQHeader::blkSize());
+                    std::copy(task.src + whole, task.src + task.size, lastBlk.begin());
+                    encryptChunk(encryptor, crcs, task.section, (uintptr_t)(task.dst + whole), lastBlk.data(), lastBlk.data(), lastBlk.size());
+                    std::copy(lastBlk.begin(), lastBlk.end(), task.dst + whole);
+                }
+            });
+            tasks.clear();
+        }
+
+    private:
+        struct Task { const uint8_t *src; uint8_t *dst; size_t size; int section; };
+
+        FPQEncryptor &encryptor;
+        FPQThreadPool &threads;
+        size_t chunkSize;
+        FPQStats *stats;
+        FPQChunkCrcs *crcs;
+        std::vector<Task> tasks;
+};
+
+#endif /* __FPQ_PIPELINE_H__ */
@@ -0,0 +1,72 @@
+/*
+* 	File: fpq_reader.cpp
+* 	Brief: Random access image reader implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include "fpq_reader.h"
+
+
+FPQReader::FPQReader(const std::string &imagePath, const FPQEncryptor &encryptor, bool mapped)
+    : encryptor(encryptor), file(new FPQFile(imagePath, FPQFile::OpenMode::ROpen)) {
+    plain = FPQHeader::load(*file, this->encryptor);
+    if (!plain.checkLayout()) throw std::runtime_error(std::string("'" + imagePath + "' has an invalid section layout!").c_str());
+    if (plain.imageSize() > file->size()) throw std::runtime_error(std::string("'" + imagePath + "' is truncated!").c_str());
+    if (mapped && FPQMapping::supported(*file)) mapping.reset(new FPQMapping(*file, plain.imageSize(), false));
+}
+
+FPQReader::View FPQReader::section(FPQHeader::Type type) const {
+    const FPQHeader::_field &field = plain.field(type);
+    return View(this, field.offset, field.size, plain.isCompressed(type));
+}
+
+uint32_t FPQReader::serial(void) const {
+    uint8_t serialBlk[512];
+    uint32_t serial;
+    View view = section(FPQHeader::Type::Serial);
+    if (view.size() != sizeof(serialBlk)) throw std::runtime_error("Invalid serial block size!");
+    view.readAt(serialBlk, sizeof(serialBlk), 0);
+    if (!FPQHeader::checkSerial(serialBlk, serial)) throw std::runtime_error("Serial block CRC mismatch, wrong encryption key?");
+    return serial;
+}
+
+void FPQReader::decryptBlocks(uint8_t *data, size_t size, uint64_t offset) const {
+    if (mapping) {
+        encryptor.encrypt(data, mapping->data() + offset, size);
+        return;
+    }
+    file->readAt(data, size, offset);
+    encryptor.encrypt(data, size);
+}
+
+void FPQReader::View::readAt(uint8_t *data, size_t size, uint64_t offset) const {
+    if (offset > length || size > length - offset) throw std::runtime_error("Read past the end of the section!");
+
+    // Partial blocks at either end go through a block of their own, the whole ones in between straight into 'data'
+    const uint32_t blk = FPQHeader::blkSize();
+    uint8_t block[512];
+    while (size) {
+        uint64_t start = offset - offset % blk;
+        if (offset == start && size >= blk) {
+            size_t whole = size - size % blk;
+            reader->decryptBlocks(data, whole, base + start);
+            data += whole;
+            offset += whole;
+            size -= whole;
+            continue;
+        }
+        size_t chunk = std::min<uint64_t>(size, start + blk - offset);
+        reader->decryptBlocks(block, blk, base + start);
+        std::copy(block + (offset - start), block + (offset - start) + chunk, data);
+        data += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+std::vector<uint8_t> FPQReader::View::read(uint64_t offset, size_t size) const {
+    std::vector<uint8_t> data(size);
+    readAt(data.data(), size, offset);
+    return data;
+}
@@ -0,0 +1,73 @@
+/*
+* 	File: fpq_reader.h
+* 	Brief: Random access to the sections of a packed image
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_READER_H__
+#define __FPQ_READER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "fpq_format.h"
+#include "fpq_io.h"
+
+/* Opens a packed image and decrypts its header only. Sections are read
+ * through views: a read decrypts just the 512-byte blocks it touches, so
+ * a few bytes from a large image cost one or two blocks, not the image.
+ * The image is mapped where FPQMapping works and read with positional
+ * I/O otherwise. Nothing is cached and reads keep no state, so any
+ * number of threads may read through one reader at once.
+ *
+ * Views point into their reader and must not outlive it. Sections keep
+ * their padding, and compressed sections are read as stored. */
+class FPQReader {
+    public:
+        class View {
+            public:
+                uint32_t size(void) const { return length; }
+
+                bool isCompressed(void) const { return compressed; }
+
+                // Decrypted bytes [offset, offset + size) of the section
+                void readAt(uint8_t *data, size_t size, uint64_t offset) const;
+                std::vector<uint8_t> read(uint64_t offset, size_t size) const;
+
+            private:
+                friend class FPQReader;
+                View(const FPQReader *reader, uint32_t base, uint32_t length, bool compressed)
+                    : reader(reader), base(base), length(length), compressed(compressed) { }
+
+                const FPQReader *reader;
+                uint32_t base, length;
+                bool compressed;
+        };
+
+        explicit FPQReader(const std::string &imagePath, const FPQEncryptor &encryptor = FPQEncryptor(), bool mapped = true);
+        FPQReader(const FPQReader &) = delete;
+        FPQReader &operator=(const FPQReader &) = delete;
+
+        // Plain header
+        FPQHeader header(void) const { return plain; }
+
+        View section(FPQHeader::Type type) const;
+
+        // Decrypts and checks the serial block
+        uint32_t serial(void) const;
+
+        bool isMapped(void) const { return mapping != NULL; }
+
+    private:
+        // Whole blocks at a block aligned image offset
+        void decryptBlocks(uint8_t *data, size_t size, uint64_t offset) const;
+
+        FPQEncryptor encryptor;
+        std::unique_ptr<FPQFile> file;
+        std::unique_ptr<FPQMapping> mapping;
+        FPQHeader plain;
+};
+
+#endif /* __FPQ_READER_H__ */
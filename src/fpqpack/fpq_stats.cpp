@@ -0,0 +1,118 @@
+/*
+* 	File: fpq_stats.cpp
+* 	Brief: Timing counters implementation and report formatting
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include "fpq_stats.h"
+#include "fpq_io.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#endif
+
+
+static const char *phaseNames[] = { "open", "read", "encrypt", "crc", "write", "header", "cache", "compress", "digest" };
+
+const int FPQStats::image;
+
+FPQStats::FPQStats() : startWall(wallNs()), startCpu(std::clock()),
+    startAllocs(FPQBuffer::allocations()), startAllocBytes(FPQBuffer::allocatedBytes()) {
+    for (auto &count : syscalls) count = 0;
+}
+
+uint64_t FPQStats::wallNs(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t FPQStats::threadCpuNs(void) {
+    #ifdef _WIN32
+        FILETIME created, exited, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+        uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+        uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+        return (k + u) * 100;
+    #else
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) return 0;
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    #endif
+}
+
+std::string FPQStats::rowName(int section) {
+    return section == image ? std::string("Image") : FPQHeader::getName(section);
+}
+
+static double toMs(uint64_t ns) { return ns / 1e6; }
+
+static double toMBps(uint64_t bytes, uint64_t ns) { return ns ? bytes / (1024.0 * 1024.0) / (ns / 1e9) : 0; }
+
+void FPQStats::print(std::ostream &os) const {
+    char line[128];
+    uint64_t totalCalls = 0, written = 0;
+
+    snprintf(line, sizeof(line), "%-8s %-8s %8s %12s %10s %10s %10s\n", "section", "phase", "calls", "bytes", "wall ms", "cpu ms", "MB/s");
+    os << line;
+    for (int s = 0; s <= image; ++s) {
+        for (int p = 0; p < PhaseNum_; ++p) {
+            const Counter &c = counters[s][p];
+            if (!c.calls) continue;
+            snprintf(line, sizeof(line), "%-8s %-8s %8llu %12llu %10.3f %10.3f %10.1f\n", rowName(s).c_str(), phaseNames[p],
+                     (unsigned long long)c.calls, (unsigned long long)c.bytes, toMs(c.wallNs), toMs(c.cpuNs), toMBps(c.bytes, c.wallNs));
+            os << line;
+            if (p == Write || p == Header) written += c.bytes;
+        }
+    }
+    for (int s = 0; s <= image; ++s) {
+        if (!syscalls[s]) continue;
+        snprintf(line, sizeof(line), "%-8s syscalls %llu\n", rowName(s).c_str(), (unsigned long long)syscalls[s]);
+        os << line;
+        totalCalls += syscalls[s];
+    }
+
+    uint64_t wall = wallNs() - startWall;
+    snprintf(line, sizeof(line), "total: %.3f ms wall, %.3f ms cpu, %llu syscalls, %llu buffers (%llu bytes), %.1f MB/s written\n",
+             toMs(wall), (std::clock() - startCpu) * 1000.0 / CLOCKS_PER_SEC, (unsigned long long)totalCalls,
+             (unsigned long long)(FPQBuffer::allocations() - startAllocs),
+             (unsigned long long)(FPQBuffer::allocatedBytes() - startAllocBytes), toMBps(written, wall));
+    os << line;
+}
+
+void FPQStats::printJson(std::ostream &os) const {
+    char num[64];
+    uint64_t totalCalls = 0;
+
+    os << "{\"sections\":[";
+    bool firstRow = true;
+    for (int s = 0; s <= image; ++s) {
+        bool used = syscalls[s] != 0;
+        for (int p = 0; p < PhaseNum_; ++p) used = used || counters[s][p].calls;
+        if (!used) continue;
+
+        os << (firstRow ? "" : ",") << "{\"name\":\"" << rowName(s) << "\",\"syscalls\":" << syscalls[s] << ",\"phases\":{";
+        bool firstPhase = true;
+        for (int p = 0; p < PhaseNum_; ++p) {
+            const Counter &c = counters[s][p];
+            if (!c.calls) continue;
+            snprintf(num, sizeof(num), "%.3f,\"cpu_ms\":%.3f,\"mbps\":%.1f", toMs(c.wallNs), toMs(c.cpuNs), toMBps(c.bytes, c.wallNs));
+            os << (firstPhase ? "" : ",") << "\"" << phaseNames[p] << "\":{\"calls\":" << c.calls << ",\"bytes\":" << c.bytes
+               << ",\"wall_ms\":" << num << "}";
+            firstPhase = false;
+        }
+        os << "}}";
+        firstRow = false;
+        totalCalls += syscalls[s];
+    }
+
+    snprintf(num, sizeof(num), "%.3f,\"cpu_ms\":%.3f", toMs(wallNs() - startWall), (std::clock() - startCpu) * 1000.0 / CLOCKS_PER_SEC);
+    os << "],\"total\":{\"wall_ms\":" << num << ",\"syscalls\":" << totalCalls
+       << ",\"buffer_allocs\":" << FPQBuffer::allocations() - startAllocs
+       << ",\"buffer_bytes\":" << FPQBuffer::allocatedBytes() - startAllocBytes << "}}" << std::endl;
+}
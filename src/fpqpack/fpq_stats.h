@@ -0,0 +1,77 @@
+/*
+* 	File: fpq_stats.h
+* 	Brief: Per-section, per-phase timing and throughput counters
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_STATS_H__
+#define __FPQ_STATS_H__
+
+#include <cstdint>
+#include <atomic>
+#include <ostream>
+#include "fpq_format.h"
+
+/* Everything that records takes an FPQStats pointer, NULL turns recording
+ * off and a Scope is then a single branch. Counters are atomic, so all
+ * workers record into one object; wall and CPU time of a phase are summed
+ * over the threads that ran it. */
+class FPQStats {
+    public:
+        enum Phase { Open = 0, Read, Encrypt, CRC, Write, Header, Cache, Compress, Digest, PhaseNum_ };
+
+        // Row for work that belongs to the whole image (output file, header fixup)
+        static const int image = FPQHeader::Type::FileNum_;
+
+        FPQStats();
+        FPQStats(const FPQStats &) = delete;
+        FPQStats &operator=(const FPQStats &) = delete;
+
+        void add(int section, Phase phase, uint64_t bytes, uint64_t wallNs, uint64_t cpuNs) {
+            Counter &counter = counters[section][phase];
+            counter.calls++;
+            counter.bytes += bytes;
+            counter.wallNs += wallNs;
+            counter.cpuNs += cpuNs;
+        }
+
+        void addSyscalls(int section, uint64_t count) { syscalls[section] += count; }
+
+        void print(std::ostream &os) const;
+        void printJson(std::ostream &os) const;
+
+        static uint64_t wallNs(void);
+        static uint64_t threadCpuNs(void);
+
+        class Scope {
+            public:
+                Scope(FPQStats *stats, int section, Phase phase, uint64_t bytes = 0)
+                    : stats(stats), section(section), phase(phase), bytes(bytes), wall(0), cpu(0) {
+                    if (stats) { wall = wallNs(); cpu = threadCpuNs(); }
+                }
+                ~Scope() { if (stats) stats->add(section, phase, bytes, wallNs() - wall, threadCpuNs() - cpu); }
+
+                // For phases whose byte count is known only at the end
+                void setBytes(uint64_t bytes) { this->bytes = bytes; }
+                Scope(const Scope &) = delete;
+                Scope &operator=(const Scope &) = delete;
+
+            private:
+                FPQStats *stats;
+                int section;
+                Phase phase;
+                uint64_t bytes, wall, cpu;
+        };
+
+    private:
+        struct Counter { std::atomic<uint64_t> calls{0}, bytes{0}, wallNs{0}, cpuNs{0}; };
+
+        static std::string rowName(int section);
+
+        Counter counters[image + 1][PhaseNum_];
+        std::atomic<uint64_t> syscalls[image + 1];
+        uint64_t startWall, startCpu, startAllocs, startAllocBytes;
+};
+
+#endif /* __FPQ_STATS_H__ */
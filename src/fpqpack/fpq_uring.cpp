@@ -0,0 +1,223 @@
+/*
+* 	File: fpq_uring.cpp
+* 	Brief: io_uring ring and packer implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include <cstring>
+#include "fpq_uring.h"
+
+#ifdef FPQ_IO_URING
+    #include <cerrno>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <linux/io_uring.h>
+#endif
+
+
+#ifdef FPQ_IO_URING
+
+FPQUring::FPQUring(unsigned entries) : ringFd(-1), pending(0), fixed(false), calls(0),
+    sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqeMem(MAP_FAILED), sqRingSize(0), cqRingSize(0), sqeSize(0) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ringFd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ringFd < 0) throw std::runtime_error("Unable to set up io_uring!");
+
+    sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = single ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqeSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqeMem = mmap(NULL, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqeMem == MAP_FAILED) {
+        release();
+        throw std::runtime_error("Unable to map io_uring!");
+    }
+
+    uint8_t *sq = (uint8_t*)sqRing, *cq = (uint8_t*)cqRing;
+    sqHead = (unsigned*)(sq + p.sq_off.head);
+    sqTail = (unsigned*)(sq + p.sq_off.tail);
+    sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sqArray = (unsigned*)(sq + p.sq_off.array);
+    cqHead = (unsigned*)(cq + p.cq_off.head);
+    cqTail = (unsigned*)(cq + p.cq_off.tail);
+    cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = cq + p.cq_off.cqes;
+    sqes = sqeMem;
+}
+
+FPQUring::~FPQUring() { release(); }
+
+void FPQUring::release(void) {
+    if (sqeMem != MAP_FAILED) munmap(sqeMem, sqeSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    if (ringFd >= 0) close(ringFd);
+    sqeMem = cqRing = sqRing = MAP_FAILED;
+    ringFd = -1;
+}
+
+bool FPQUring::supported(void) {
+    static int probed = -1;
+    if (probed < 0) {
+        try { FPQUring probe(2); probed = 1; }
+        catch (const std::exception &) { probed = 0; }
+    }
+    return probed;
+}
+
+bool FPQUring::registerBuffers(const std::vector<FPQBuffer*> &buffers) {
+    std::vector<struct iovec> iovs;
+    for (auto buffer : buffers) iovs.push_back({ buffer->data(), buffer->size() });
+    calls++;
+    fixed = !syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iovs.data(), iovs.size());
+    return fixed;
+}
+
+void FPQUring::queue(int op, int fd, const uint8_t *data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData) {
+    unsigned tail = *sqTail, index = tail & *sqMask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe*)sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = fixed ? bufIndex : 0;
+    sqe->user_data = userData;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    pending++;
+}
+
+void FPQUring::read(int fd, uint8_t *data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData) {
+    queue(fixed ? IORING_OP_READ_FIXED : IORING_OP_READ, fd, data, size, offset, bufIndex, userData);
+}
+
+void FPQUring::write(int fd, const uint8_t *data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData) {
+    queue(fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, fd, data, size, offset, bufIndex, userData);
+}
+
+void FPQUring::wait(uint64_t &userData, int &res) {
+    unsigned head = *cqHead;
+    while (pending || head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        calls++;
+        int rc = syscall(__NR_io_uring_enter, ringFd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc < 0) throw std::runtime_error("io_uring_enter failed!");
+        pending -= rc;
+    }
+
+    struct io_uring_cqe *cqe = (struct io_uring_cqe*)cqes + (head & *cqMask);
+    userData = cqe->user_data;
+    res = cqe->res;
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+FPQUring::FPQUring(unsigned) { throw std::runtime_error("io_uring is not available!"); }
+FPQUring::~FPQUring() { }
+void FPQUring::release(void) { }
+bool FPQUring::supported(void) { return false; }
+bool FPQUring::registerBuffers(const std::vector<FPQBuffer*> &) { return false; }
+void FPQUring::read(int, uint8_t*, unsigned, uint64_t, int, uint64_t) { }
+void FPQUring::write(int, const uint8_t*, unsigned, uint64_t, int, uint64_t) { }
+void FPQUring::wait(uint64_t &, int &) { throw std::runtime_error("io_uring is not available!"); }
+
+#endif
+
+FPQUringPacker::FPQUringPacker(FPQEncryptor &encryptor, size_t bufferSize, unsigned depth, FPQStats *stats)
+    : encryptor(encryptor), bufferSize(bufferSize), stats(stats), crcs(NULL), ring(depth), slots(depth) {
+    std::vector<FPQBuffer*> registered;
+    for (unsigned i = 0; i < depth; ++i) {
+        buffers.emplace_back(new FPQBuffer(bufferSize));
+        registered.push_back(buffers.back().get());
+    }
+    ring.registerBuffers(registered);     // plain reads and writes if the kernel refuses
+}
+
+void FPQUringPacker::add(FPQFile &input, uint64_t srcOffset, uint32_t size, FPQFile &output, uint64_t dstOffset, int section) {
+    for (uint64_t pos = 0; pos < size; pos += bufferSize) {
+        uint32_t chunk = std::min<uint64_t>(size - pos, bufferSize);
+        tasks.push_back({ &input, srcOffset + pos, &output, dstOffset + pos, chunk, section });
+    }
+}
+
+// Queues the rest of the slot's current read or write, short transfers resume where they stopped
+void FPQUringPacker::submit(size_t slot) {
+    Slot &s = slots[slot];
+    const Task &task = tasks[s.task];
+    uint8_t *data = buffers[slot]->data() + s.done;
+    if (s.writing) ring.write(task.output->handle(), data, s.total - s.done, task.dstOffset + s.done, slot, slot);
+    else ring.read(task.input->handle(), data, s.total - s.done, task.srcOffset + s.done, slot, slot);
+}
+
+void FPQUringPacker::run(void) {
+    size_t next = 0, inflight = 0;
+    std::vector<size_t> freeSlots;
+    for (size_t i = slots.size(); i--; ) freeSlots.push_back(i);
+    uint64_t startCalls = ring.syscalls();
+    if (!tasks.empty()) fflush(NULL);       // positional I/O bypasses stdio buffers
+    std::string error;
+
+    // after a failure nothing new is queued, the rest still in flight is waited for before the buffers can go
+    while ((next < tasks.size() && error.empty()) || inflight) {
+        while (next < tasks.size() && error.empty() && !freeSlots.empty()) {
+            size_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            slots[slot] = { next, false, 0, tasks[next].size, stats ? FPQStats::wallNs() : 0 };
+            next++;
+            submit(slot);
+            inflight++;
+        }
+
+        uint64_t userData = 0;
+        int res = 0;
+        ring.wait(userData, res);
+        Slot &s = slots[userData];
+        const Task &task = tasks[s.task];
+        if (res <= 0 && error.empty()) {
+            FPQFile *file = s.writing ? task.output : task.input;
+            error = "Unable to " + std::string(s.writing ? "write to" : "read from") + " '" + file->getPath() + "'!";
+        }
+        if (!error.empty()) {
+            inflight--;
+            continue;
+        }
+
+        s.done += res;
+        if (s.done < s.total) {
+            submit(userData);
+            continue;
+        }
+
+        if (stats) stats->add(task.section, s.writing ? FPQStats::Write : FPQStats::Read, s.total, FPQStats::wallNs() - s.started, 0);
+        if (s.writing) {
+            freeSlots.push_back(userData);
+            inflight--;
+            continue;
+        }
+
+        uint32_t bytesToWrite = FPQHeader::align(task.size);
+        {
+            FPQStats::Scope scope(stats, task.section, FPQStats::Encrypt, bytesToWrite);
+            uint8_t *data = buffers[userData]->data();
+            std::fill(data + task.size, data + bytesToWrite, 0);
+            encryptChunk(encryptor, crcs, task.section, task.dstOffset, data, data, bytesToWrite);
+        }
+        s = { s.task, true, 0, bytesToWrite, stats ? FPQStats::wallNs() : 0 };
+        submit(userData);
+    }
+
+    if (stats) stats->addSyscalls(FPQStats::image, ring.syscalls() - startCalls);
+    tasks.clear();
+    if (!error.empty()) throw std::runtime_error(error.c_str());
+}
@@ -0,0 +1,89 @@
+/*
+* 	File: fpq_uring.h
+* 	Brief: io_uring ring over raw syscalls and the packer driving it
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQ_URING_H__
+#define __FPQ_URING_H__
+
+#include <cstdint>
+#include <vector>
+#include "fpq_format.h"
+#include "fpq_io.h"
+#include "fpq_stats.h"
+#include "fpq_pipeline.h"
+
+/* Just enough of io_uring for positional reads and writes, without
+ * liburing. Built only where <linux/io_uring.h> exists; supported() also
+ * probes the running kernel, which may have io_uring disabled. */
+class FPQUring {
+    public:
+        explicit FPQUring(unsigned entries);
+        ~FPQUring();
+        FPQUring(const FPQUring &) = delete;
+        FPQUring &operator=(const FPQUring &) = delete;
+
+        static bool supported(void);
+
+        // Registered buffers are addressed by index in read() and write(), false if the kernel refused them
+        bool registerBuffers(const std::vector<FPQBuffer*> &buffers);
+
+        void read(int fd, uint8_t *data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData);
+        void write(int fd, const uint8_t *data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData);
+
+        // Submits everything queued and waits for one completion, res is the byte count or -errno
+        void wait(uint64_t &userData, int &res);
+
+        uint64_t syscalls(void) const { return calls; }
+
+    private:
+        void release(void);
+        void queue(int op, int fd, const uint8_t *data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData);
+
+        int ringFd;
+        unsigned pending;
+        bool fixed;
+        uint64_t calls;
+        void *sqRing, *cqRing, *sqeMem;
+        size_t sqRingSize, cqRingSize, sqeSize;
+        unsigned *sqHead, *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+        void *cqes, *sqes;
+};
+
+/* Same tasks as FPQParallelPacker, driven by one thread: up to 'depth'
+ * chunks are in flight, each read is encrypted as soon as it completes
+ * and its write queued, while the other reads and writes keep the
+ * device busy. */
+class FPQUringPacker {
+    public:
+        FPQUringPacker(FPQEncryptor &encryptor, size_t bufferSize, unsigned depth, FPQStats *stats = NULL);
+
+        void add(FPQFile &input, uint64_t srcOffset, uint32_t size, FPQFile &output, uint64_t dstOffset, int section = FPQStats::image);
+
+        void add(FPQFile &input, FPQFile &output, uint64_t offset, int section = FPQStats::image) {
+            add(input, 0, input.size(), output, offset, section);
+        }
+
+        void setCrcs(FPQChunkCrcs *crcs) { this->crcs = crcs; }
+
+        void run(void);
+
+    private:
+        struct Task { FPQFile *input; uint64_t srcOffset; FPQFile *output; uint64_t dstOffset; uint32_t size; int section; };
+        struct Slot { size_t task; bool writing; uint32_t done, total; uint64_t started; };
+
+        void submit(size_t slot);
+
+        FPQEncryptor &encryptor;
+        size_t bufferSize;
+        FPQStats *stats;
+        FPQChunkCrcs *crcs;
+        std::vector<std::unique_ptr<FPQBuffer>> buffers;
+        FPQUring ring;          // after the buffers: destroyed first, so the kernel lets go of them before they are freed
+        std::vector<Slot> slots;
+        std::vector<Task> tasks;
+};
+
+#endif /* __FPQ_URING_H__ */
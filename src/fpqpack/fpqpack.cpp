@@ -0,0 +1,70 @@
+/*
+* 	File: fpqpack.cpp
+* 	Brief: libfpqpack in-memory packer implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#include "fpqpack.h"
+
+
+FPQPacker::FPQPacker(const FPQEncryptor &encryptor, size_t bufferSize)
+    : encryptor(encryptor), buffer(bufferSize), serial(FPQSerial().get()) {
+    if (!bufferSize || bufferSize % FPQHeader::blkSize())
+        throw std::runtime_error("Buffer size must be a multiple of the block size!");
+}
+
+void FPQPacker::setSection(FPQHeader::Type type, const FPQSection &section) {
+    if (type == FPQHeader::Type::Serial || type >= FPQHeader::Type::FileNum_)
+        throw std::runtime_error("Invalid section type!");
+    sections[type] = section;
+}
+
+FPQHeader FPQPacker::header(void) const {
+    FPQHeader header;
+    for (auto &section : sections) header.setSize((FPQHeader::Type)section.first, section.second.size());
+    header.setSize(FPQHeader::Type::Serial, FPQHeader::blkSize());
+    header.updateOffsets();
+    return header;
+}
+
+FPQHeader FPQPacker::pack(const FPQSink &sink) {
+    FPQHeader plain = header();
+
+    std::vector<uint8_t> block(plain.begin(), plain.end());
+    encryptor.encrypt(block);
+    sink(block.data(), block.size());
+
+    for (int i = 0; i < FPQHeader::Type::FileNum_; ++i) {
+        if (i == FPQHeader::Type::Serial) {
+            block = FPQHeader::makeSerial(serial);
+            encryptor.encrypt(block);
+            sink(block.data(), block.size());
+            continue;
+        }
+        if (!sections.count(i)) continue;
+
+        const FPQSection &section = sections[i];
+        for (uint32_t pos = 0; pos < section.size(); ) {
+            uint32_t chunk = std::min<size_t>(section.size() - pos, buffer.size());
+            uint32_t padded = FPQHeader::align(chunk);
+
+            if (section.data()) encryptor.encrypt(buffer.data(), section.data() + pos, chunk);
+            else {
+                section.read(buffer.data(), chunk);
+                encryptor.encrypt(buffer.data(), chunk - chunk % FPQHeader::blkSize());
+            }
+            if (padded != chunk) {
+                // only the last chunk of a section is partial: pad it and encrypt its last block
+                uint32_t last = chunk - chunk % FPQHeader::blkSize();
+                if (section.data()) std::copy(section.data() + pos + last, section.data() + pos + chunk, buffer.data() + last);
+                std::fill(buffer.data() + chunk, buffer.data() + padded, 0);
+                encryptor.encrypt(buffer.data() + last, FPQHeader::blkSize());
+            }
+            sink(buffer.data(), padded);
+            pos += chunk;
+        }
+    }
+
+    return plain;
+}
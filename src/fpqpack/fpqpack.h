@@ -0,0 +1,90 @@
+/*
+* 	File: fpqpack.h
+* 	Brief: libfpqpack public interface
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __FPQPACK_H__
+#define __FPQPACK_H__
+
+#include <map>
+#include <functional>
+#include "fpq_format.h"
+#include "fpq_io.h"
+#include "fpq_stats.h"
+#include "fpq_pipeline.h"
+#include "fpq_uring.h"
+#include "fpq_cache.h"
+#include "fpq_compress.h"
+#include "fpq_direct.h"
+#include "fpq_digest.h"
+#include "fpq_reader.h"
+#include "fpq_image.h"
+#include "fpq_delta.h"
+#include "fpq_daemon.h"
+
+/* One section of an image: either a span of memory or a reader callback
+ * that delivers exactly 'size' bytes in order. The reader is called with
+ * a buffer and the number of bytes wanted and returns how many it wrote,
+ * zero meaning end of data. */
+class FPQSection {
+    public:
+        typedef std::function<size_t(uint8_t *data, size_t size)> Reader;
+
+        FPQSection() : span(NULL), length(0) { }
+        FPQSection(const uint8_t *data, uint32_t size) : span(data), length(size) { }
+        FPQSection(uint32_t size, Reader reader) : span(NULL), length(size), reader(reader) { }
+
+        uint32_t size(void) const { return length; }
+
+        const uint8_t *data(void) const { return span; }
+
+        void read(uint8_t *data, size_t size) const {
+            while (size) {
+                size_t done = reader ? reader(data, size) : 0;
+                if (!done || done > size) throw std::runtime_error("Section reader ended early!");
+                data += done;
+                size -= done;
+            }
+        }
+
+    private:
+        const uint8_t *span;
+        uint32_t length;
+        Reader reader;
+};
+
+/* Called with consecutive pieces of the packed image */
+typedef std::function<void(const uint8_t *data, size_t size)> FPQSink;
+
+/* In-memory packer: no files, no global state. The layout is computed
+ * from the section sizes, so the image is produced strictly in order,
+ * header first, through one reusable buffer. Packers are independent
+ * and can run on different threads at the same time. */
+class FPQPacker {
+    public:
+        explicit FPQPacker(const FPQEncryptor &encryptor = FPQEncryptor(), size_t bufferSize = DEFAULT_BUFFER_MB * 1024 * 1024);
+
+        void setSection(FPQHeader::Type type, const FPQSection &section);
+
+        void setSerial(uint32_t serial) { this->serial = serial; }
+
+        void clear(void) { sections.clear(); }
+
+        // Plain header for the current sections
+        FPQHeader header(void) const;
+
+        uint32_t imageSize(void) const { return header().imageSize(); }
+
+        // Emits the whole image to the sink, returns the plain header
+        FPQHeader pack(const FPQSink &sink);
+
+    private:
+        FPQEncryptor encryptor;
+        FPQBuffer buffer;
+        std::map<int,FPQSection> sections;
+        uint32_t serial;
+};
+
+#endif /* __FPQPACK_H__ */
@@ -0,0 +1,177 @@
+/*
+* 	File: lz.c
+* 	Brief: Fast LZ77 block codec implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+/*
+*	Byte oriented LZ77 in the spirit of LZ4: every sequence is a token
+*	(literal length << 4 | match length - 4), extra length bytes when a
+*	nibble is 15, the literals, and a 16-bit little-endian match offset.
+*	The last sequence has literals only. Matches are found through one
+*	hash table of 4-byte prefixes and skip ahead faster over data that
+*	does not compress.
+*/
+#ifdef __cplusplus
+extern "C" {  
+#endif
+
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MIN_MATCH		4
+#define LZ_MAX_OFFSET		65535
+#define LZ_HASH_BITS		14
+#define LZ_LAST_LITERALS	5		// the block always ends with literals
+#define LZ_MATCH_LIMIT		12		// no match starts closer than this to the end
+
+
+static inline uint32_t lz_read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t seq) {
+	return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static inline uint8_t *lz_length(uint8_t *op, size_t len) {
+	for (; len >= 255; len -= 255) *op++ = 255;
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/* Returns the position where src[a..] and src[b..] stop matching, at most 'limit' */
+static inline size_t lz_extend(const uint8_t *src, size_t a, size_t b, size_t limit) {
+	while (b + sizeof(uint64_t) <= limit) {
+		uint64_t x, y;
+		memcpy(&x, src + a, sizeof(x));
+		memcpy(&y, src + b, sizeof(y));
+		if (x != y) {
+			x ^= y;
+			while (!(x & 0xff)) {
+				x >>= 8;
+				b++;
+			}
+			return b;
+		}
+		a += sizeof(uint64_t);
+		b += sizeof(uint64_t);
+	}
+	while (b < limit && src[a] == src[b]) {
+		a++;
+		b++;
+	}
+	return b;
+}
+
+size_t LZ_Bound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+size_t LZ_Compress(uint8_t *dst, size_t dstCap, const uint8_t *src, size_t size) {
+
+	uint32_t table[1 << LZ_HASH_BITS];
+	uint8_t *op = dst, *end = dst + dstCap;
+	size_t ip = 0, anchor = 0;
+
+	memset(table, 0, sizeof(table));
+	while (size >= LZ_MATCH_LIMIT && ip < size - LZ_MATCH_LIMIT) {
+		uint32_t seq = lz_read32(src + ip);
+		uint32_t h = lz_hash(seq);
+		size_t cand = table[h];
+		table[h] = (uint32_t)ip;
+
+		if (cand >= ip || ip - cand > LZ_MAX_OFFSET || lz_read32(src + cand) != seq) {
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+
+		size_t mlen = LZ_MIN_MATCH, lit = ip - anchor;
+		mlen = lz_extend(src, cand + mlen, ip + mlen, size - LZ_LAST_LITERALS) - ip;
+		if ((size_t)(end - op) < 1 + lit + lit / 255 + 1 + 2 + (mlen - LZ_MIN_MATCH) / 255 + 1) return 0;
+
+		uint8_t *token = op++;
+		*token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+		if (lit >= 15) op = lz_length(op, lit - 15);
+		memcpy(op, src + anchor, lit);
+		op += lit;
+		*op++ = (uint8_t)(ip - cand);
+		*op++ = (uint8_t)((ip - cand) >> 8);
+		*token |= (uint8_t)(mlen - LZ_MIN_MATCH >= 15 ? 15 : mlen - LZ_MIN_MATCH);
+		if (mlen - LZ_MIN_MATCH >= 15) op = lz_length(op, mlen - LZ_MIN_MATCH - 15);
+
+		ip += mlen;
+		anchor = ip;
+	}
+
+	size_t lit = size - anchor;
+	if ((size_t)(end - op) < 1 + lit + lit / 255 + 1) return 0;
+	*op = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+	op++;
+	if (lit >= 15) op = lz_length(op, lit - 15);
+	memcpy(op, src + anchor, lit);
+	return (size_t)(op + lit - dst);
+}
+
+int64_t LZ_Decompress(uint8_t *dst, size_t dstCap, const uint8_t *src, size_t size) {
+
+	size_t ip = 0, op = 0;
+
+	while (ip < size) {
+		uint8_t token = src[ip++], b;
+		size_t lit = token >> 4, mlen = token & 15;
+
+		if (lit == 15) {
+			do {
+				if (ip >= size) return -1;
+				b = src[ip++];
+				lit += b;
+			} while (b == 255);
+		}
+		if (lit > size - ip || lit > dstCap - op) return -1;
+		// short runs dominate text: one fixed size copy when both buffers have room for it
+		if (lit <= 16 && size - ip >= 16 && dstCap - op >= 16) memcpy(dst + op, src + ip, 16);
+		else memcpy(dst + op, src + ip, lit);
+		ip += lit;
+		op += lit;
+		if (ip == size) break;
+
+		if (size - ip < 2) return -1;
+		size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+		ip += 2;
+		if (!offset || offset > op) return -1;
+
+		if (mlen == 15) {
+			do {
+				if (ip >= size) return -1;
+				b = src[ip++];
+				mlen += b;
+			} while (b == 255);
+		}
+		mlen += LZ_MIN_MATCH;
+		if (mlen > dstCap - op) return -1;
+
+		if (mlen <= 16 && offset >= 16 && dstCap - op >= 16) {
+			memcpy(dst + op, dst + op - offset, 16);
+			op += mlen;
+			continue;
+		}
+		// overlapping matches repeat a period of 'offset' bytes, double it per copy
+		while (mlen) {
+			size_t n = offset < mlen ? offset : mlen;
+			memcpy(dst + op, dst + op - offset, n);
+			op += n;
+			mlen -= n;
+			offset += n;
+		}
+	}
+
+	return (int64_t)op;
+}
+
+#ifdef __cplusplus  
+} // extern "C"  
+#endif
@@ -0,0 +1,31 @@
+/*
+* 	File: lz.h
+* 	Brief: Fast LZ77 block codec interface
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#ifdef __cplusplus
+extern "C" {  
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* Worst case compressed size of 'size' bytes */
+size_t LZ_Bound(size_t size);
+/* Returns the compressed size, 0 if it does not fit into dstCap */
+size_t LZ_Compress(uint8_t *dst, size_t dstCap, const uint8_t *src, size_t size);
+/* Returns the decompressed size, -1 on corrupted input or if it does not fit into dstCap */
+int64_t LZ_Decompress(uint8_t *dst, size_t dstCap, const uint8_t *src, size_t size);
+
+
+#ifdef __cplusplus  
+} // extern "C"  
+#endif
+
+#endif /* __LZ_H__ */
@@ -0,0 +1,233 @@
+/*
+* 	File: sha256.c
+* 	Brief: SHA-256 implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+/*
+*	FIPS 180-4 SHA-256. Whole blocks go to the SHA extensions (SHA-NI,
+*	two rounds per SHA256RNDS2, schedule from SHA256MSG1/MSG2) when the
+*	CPU has them, otherwise to the portable rounds below.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include <pthread.h>
+#include "sha256.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SHA256_X86
+	#include <immintrin.h>
+	#include <cpuid.h>
+#endif
+
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+typedef void (*sha256_kernel_t)(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+static const uint32_t sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static sha256_kernel_t sha256_kernel = NULL;
+static pthread_once_t sha256_once = PTHREAD_ONCE_INIT;
+static const char *sha256_kernel_name = "portable";
+
+
+static void sha256_portable(uint32_t state[8], const uint8_t *data, size_t blocks) {
+
+	uint32_t w[64];
+
+	while (blocks--) {
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+		for (int i = 0; i < 16; i++) {
+			w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 |
+			       (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+		}
+		for (int i = 16; i < 64; i++) {
+			uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		for (int i = 0; i < 64; i++) {
+			uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+			uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		data += SHA256_BLOCK_SIZE;
+	}
+}
+
+#ifdef SHA256_X86
+
+/* Four rounds per step; from step 3 on the schedule runs one group ahead */
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha256_shani(uint32_t state[8], const uint8_t *data, size_t blocks) {
+
+	const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+	__m128i state0, state1, save0, save1, msg, tmp, w[4];
+
+	/* ABCD, EFGH -> ABEF, CDGH as the round instruction wants them */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	while (blocks--) {
+		save0 = state0;
+		save1 = state1;
+
+		#pragma GCC unroll 16		// keeps w[] in registers
+		for (int i = 0; i < 16; i++) {
+			if (i < 4) w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), mask);
+
+			msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			if (i >= 3 && i <= 14) {
+				tmp = _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4);
+				w[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(i + 1) & 3], tmp), w[i & 3]);
+			}
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+			if (i >= 1 && i <= 12) w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+		}
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+#endif /* SHA256_X86 */
+
+
+static void sha256_resolve(void) {
+
+	sha256_kernel_t kernel = sha256_portable;
+
+#ifdef SHA256_X86
+	unsigned eax, ebx, ecx, edx;
+
+	__builtin_cpu_init();
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29)) &&
+	    __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1")) {
+		kernel = sha256_shani;
+		sha256_kernel_name = "sha-ni";
+	}
+#endif
+
+	sha256_kernel = kernel;
+}
+
+
+void SHA256_Init(SHA256_Context *ctx) {
+
+	static const uint32_t iv[8] = {
+		0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+	};
+
+	pthread_once(&sha256_once, sha256_resolve);
+	memcpy(ctx->state, iv, sizeof(iv));
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+void SHA256_Update(SHA256_Context *ctx, const uint8_t *data, size_t size) {
+
+	ctx->length += size;
+
+	if (ctx->used) {
+		size_t fill = SHA256_BLOCK_SIZE - ctx->used;
+		if (fill > size) fill = size;
+		memcpy(ctx->block + ctx->used, data, fill);
+		ctx->used += fill;
+		data += fill;
+		size -= fill;
+		if (ctx->used < SHA256_BLOCK_SIZE) return;
+		sha256_kernel(ctx->state, ctx->block, 1);
+		ctx->used = 0;
+	}
+
+	if (size >= SHA256_BLOCK_SIZE) {
+		sha256_kernel(ctx->state, data, size / SHA256_BLOCK_SIZE);
+		data += size & ~(size_t)(SHA256_BLOCK_SIZE - 1);
+		size &= SHA256_BLOCK_SIZE - 1;
+	}
+
+	memcpy(ctx->block, data, size);
+	ctx->used = size;
+}
+
+void SHA256_Final(SHA256_Context *ctx, uint8_t digest[SHA256_DIGEST_SIZE]) {
+
+	uint64_t bits = ctx->length * 8;
+
+	ctx->block[ctx->used++] = 0x80;
+	if (ctx->used > SHA256_BLOCK_SIZE - 8) {
+		memset(ctx->block + ctx->used, 0, SHA256_BLOCK_SIZE - ctx->used);
+		sha256_kernel(ctx->state, ctx->block, 1);
+		ctx->used = 0;
+	}
+	memset(ctx->block + ctx->used, 0, SHA256_BLOCK_SIZE - 8 - ctx->used);
+	for (int i = 0; i < 8; i++) {
+		ctx->block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+	}
+	sha256_kernel(ctx->state, ctx->block, 1);
+
+	for (int i = 0; i < 8; i++) {
+		digest[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)ctx->state[i];
+	}
+}
+
+void SHA256_Calculate(const uint8_t *data, size_t size, uint8_t digest[SHA256_DIGEST_SIZE]) {
+
+	SHA256_Context ctx;
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, data, size);
+	SHA256_Final(&ctx, digest);
+}
+
+const char *SHA256_KernelName(void) {
+
+	pthread_once(&sha256_once, sha256_resolve);
+	return sha256_kernel_name;
+}
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,43 @@
+/*
+* 	File: sha256.h
+* 	Brief: SHA-256 interface
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_DIGEST_SIZE	32
+#define SHA256_BLOCK_SIZE	64
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t length;			// bytes so far
+	uint8_t block[SHA256_BLOCK_SIZE];	// partial block
+	size_t used;
+} SHA256_Context;
+
+
+/* Streaming interface: SHA256_Init, any number of SHA256_Update, SHA256_Final */
+void SHA256_Init(SHA256_Context *ctx);
+void SHA256_Update(SHA256_Context *ctx, const uint8_t *data, size_t size);
+void SHA256_Final(SHA256_Context *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+void SHA256_Calculate(const uint8_t *data, size_t size, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+const char *SHA256_KernelName(void);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* __SHA256_H__ */
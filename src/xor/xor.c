@@ -0,0 +1,167 @@
+/*
+* 	File: xor.c
+* 	Brief: XOR keystream implementation
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+/*
+*	The stream is one block (512 bytes) of the repeated key, so the
+*	vector kernels keep the whole block in registers and walk the data
+*	one block at a time. The kernel is picked once by CPU features:
+*	AVX-512 -> AVX2 -> SSE2 -> scalar.
+*/
+#ifdef __cplusplus
+extern "C" {  
+#endif
+
+#include <string.h>
+#include <pthread.h>
+#include "xor.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define XOR_X86
+	#include <immintrin.h>
+#endif
+
+typedef void (*xor_kernel_t)(uint8_t *, const uint8_t *, size_t, const uint8_t *);
+
+
+static size_t xor_tail(uint8_t *dst, const uint8_t *src, size_t pos, size_t size, const uint8_t *stream) {
+
+	for (; pos < size; pos++) {
+		dst[pos] = src[pos] ^ stream[pos % XOR_STREAM_SIZE];
+	}
+
+	return pos;
+}
+
+static void xor_scalar(uint8_t *dst, const uint8_t *src, size_t size, const uint8_t *stream) {
+
+	size_t pos = 0;
+	uint64_t d, k;
+
+	for (; pos + XOR_STREAM_SIZE <= size; pos += XOR_STREAM_SIZE) {
+		for (size_t i = 0; i < XOR_STREAM_SIZE; i += sizeof(uint64_t)) {
+			memcpy(&d, src + pos + i, sizeof(d));
+			memcpy(&k, stream + i, sizeof(k));
+			d ^= k;
+			memcpy(dst + pos + i, &d, sizeof(d));
+		}
+	}
+
+	xor_tail(dst, src, pos, size, stream);
+}
+
+#ifdef XOR_X86
+
+__attribute__((target("sse2")))
+static void xor_sse2(uint8_t *dst, const uint8_t *src, size_t size, const uint8_t *stream) {
+
+	size_t pos = 0;
+
+	for (; pos + XOR_STREAM_SIZE <= size; pos += XOR_STREAM_SIZE) {
+		for (size_t i = 0; i < XOR_STREAM_SIZE; i += sizeof(__m128i)) {
+			__m128i d = _mm_loadu_si128((const __m128i *)(src + pos + i));
+			__m128i k = _mm_loadu_si128((const __m128i *)(stream + i));
+			_mm_storeu_si128((__m128i *)(dst + pos + i), _mm_xor_si128(d, k));
+		}
+	}
+
+	xor_tail(dst, src, pos, size, stream);
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t *dst, const uint8_t *src, size_t size, const uint8_t *stream) {
+
+	size_t pos = 0;
+	__m256i k[XOR_STREAM_SIZE / sizeof(__m256i)];
+
+	for (size_t i = 0; i < XOR_STREAM_SIZE / sizeof(__m256i); i++) {
+		k[i] = _mm256_loadu_si256((const __m256i *)stream + i);
+	}
+
+	for (; pos + XOR_STREAM_SIZE <= size; pos += XOR_STREAM_SIZE) {
+		const __m256i *in = (const __m256i *)(src + pos);
+		__m256i *out = (__m256i *)(dst + pos);
+		for (size_t i = 0; i < XOR_STREAM_SIZE / sizeof(__m256i); i++) {
+			_mm256_storeu_si256(out + i, _mm256_xor_si256(_mm256_loadu_si256(in + i), k[i]));
+		}
+	}
+
+	xor_tail(dst, src, pos, size, stream);
+}
+
+__attribute__((target("avx512f")))
+static void xor_avx512(uint8_t *dst, const uint8_t *src, size_t size, const uint8_t *stream) {
+
+	size_t pos = 0;
+	__m512i k[XOR_STREAM_SIZE / sizeof(__m512i)];
+
+	for (size_t i = 0; i < XOR_STREAM_SIZE / sizeof(__m512i); i++) {
+		k[i] = _mm512_loadu_si512((const __m512i *)stream + i);
+	}
+
+	for (; pos + XOR_STREAM_SIZE <= size; pos += XOR_STREAM_SIZE) {
+		const __m512i *in = (const __m512i *)(src + pos);
+		__m512i *out = (__m512i *)(dst + pos);
+		for (size_t i = 0; i < XOR_STREAM_SIZE / sizeof(__m512i); i++) {
+			_mm512_storeu_si512(out + i, _mm512_xor_si512(_mm512_loadu_si512(in + i), k[i]));
+		}
+	}
+
+	xor_tail(dst, src, pos, size, stream);
+}
+
+#endif /* XOR_X86 */
+
+
+static xor_kernel_t xor_kernel = NULL;
+static pthread_once_t xor_once = PTHREAD_ONCE_INIT;
+static const char *xor_kernel_name = "scalar";
+
+/* Picked under pthread_once(), callers may race to the first use */
+static void xor_resolve(void) {
+
+	xor_kernel_t kernel = xor_scalar;
+
+#ifdef XOR_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		kernel = xor_avx512;
+		xor_kernel_name = "avx512";
+	}
+	else if (__builtin_cpu_supports("avx2")) {
+		kernel = xor_avx2;
+		xor_kernel_name = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2")) {
+		kernel = xor_sse2;
+		xor_kernel_name = "sse2";
+	}
+#endif
+
+	xor_kernel = kernel;
+}
+
+
+void XOR_Apply(uint8_t *data, size_t size, const uint8_t *stream) {
+	XOR_ApplyCopy(data, data, size, stream);
+}
+
+void XOR_ApplyCopy(uint8_t *dst, const uint8_t *src, size_t size, const uint8_t *stream) {
+
+	pthread_once(&xor_once, xor_resolve);
+	xor_kernel(dst, src, size, stream);
+}
+
+const char *XOR_KernelName(void) {
+
+	pthread_once(&xor_once, xor_resolve);
+	return xor_kernel_name;
+}
+
+
+#ifdef __cplusplus  
+} // extern "C"  
+#endif
@@ -0,0 +1,32 @@
+/*
+* 	File: xor.h
+* 	Brief: XOR keystream interface
+* 	Author: rampopula
+* 	Date: October 16, 2026
+*/
+
+#ifndef __XOR_H__
+#define __XOR_H__
+
+#ifdef __cplusplus
+extern "C" {  
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define XOR_STREAM_SIZE		512
+
+
+/* XORs data[i] with stream[i % XOR_STREAM_SIZE] */
+void XOR_Apply(uint8_t *data, size_t size, const uint8_t *stream);
+/* dst[i] = src[i] ^ stream[i % XOR_STREAM_SIZE], dst may be equal to src */
+void XOR_ApplyCopy(uint8_t *dst, const uint8_t *src, size_t size, const uint8_t *stream);
+const char *XOR_KernelName(void);
+
+
+#ifdef __cplusplus  
+} // extern "C"  
+#endif
+
+#endif /* __XOR_H__ */